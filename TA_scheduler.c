@@ -0,0 +1,94 @@
+/*
+ * Timer_A0 compare event scheduler
+ *
+ * HouYu Li <karajan_ii@hotmail.com>
+ *
+ * No license applied. Use as you wish.
+ *
+ * TACCR0 is always programmed for the earliest pending event only,
+ * so the CPU is woken when there is something to do instead of on
+ * a fixed tick.
+ *
+ * All event times are kept relative to _sched_ref, the timer count
+ * at which events were last collected. An event may lie up to 65535
+ * counts ahead of it, which is enough as the second event is always
+ * pending and the reference moves forward at least once per second.
+ *
+ * Timer counts are unsigned short so that wrapping is the same on
+ * the host simulator, where int is wider than 16 bits.
+ */
+
+#include "hal.h"
+
+#include "TA_scheduler.h"
+
+unsigned short _sched_time[_EV_COUNT];      // Timer count each event is due at
+unsigned char _sched_pending = 0;           // One bit per pending event
+unsigned short _sched_ref = 0;              // Timer count events were last collected at
+
+/**
+ * Start from the current timer count with nothing pending
+ */
+void _sched_init() {
+    _sched_ref = TAR;
+    _sched_pending = 0;
+}
+
+/**
+ * Set an event at an absolute timer count
+ * Call from the Timer_A0 ISR or with interrupts disabled, then _sched_arm()
+ */
+void _sched_at(unsigned char event, unsigned short time) {
+    _sched_time[event] = time;
+    _sched_pending |= _EV_BIT(event);
+}
+
+/**
+ * Set an event some timer counts from now, for use in the main loop
+ * ticks should stay below 32768
+ */
+void _sched_post(unsigned char event, unsigned short ticks) {
+    __disable_interrupt();
+    _sched_at(event, TAR + ticks);
+    _sched_arm();
+    __enable_interrupt();
+}
+
+/**
+ * Collect events that are due, called first thing in the Timer_A0 ISR
+ * Returns one bit per due event
+ */
+unsigned char _sched_take_due() {
+    unsigned short elapsed;
+    unsigned char event, bit, due = 0;
+
+    elapsed = TAR - _sched_ref;
+    for (event = 0, bit = 1; event < _EV_COUNT; event++, bit <<= 1) {
+        if ((_sched_pending & bit) &&
+                (unsigned short)(_sched_time[event] - _sched_ref) <= elapsed)
+            due |= bit;
+    }
+    _sched_pending &= ~due;
+    _sched_ref += elapsed;
+    return due;
+}
+
+/**
+ * Program TACCR0 for the earliest pending event
+ */
+void _sched_arm() {
+    unsigned short distance, nearest = 0xFFFF;
+    unsigned char event, bit;
+
+    for (event = 0, bit = 1; event < _EV_COUNT; event++, bit <<= 1) {
+        if (!(_sched_pending & bit))
+            continue;
+        distance = _sched_time[event] - _sched_ref;
+        if (distance < nearest)
+            nearest = distance;
+    }
+    TACCR0 = _sched_ref + nearest;
+    // The timer may already have passed it while we were busy
+    if ((unsigned short)(TAR - _sched_ref) >= nearest)
+        TACCTL0 |= CCIFG;
+}
@@ -0,0 +1,32 @@
+/*
+ * Timer_A0 compare event scheduler
+ *
+ * HouYu Li <karajan_ii@hotmail.com>
+ *
+ * No license applied. Use as you wish.
+ */
+
+#ifndef TA_SCHEDULER_H_
+#define TA_SCHEDULER_H_
+
+/**
+ * Scheduled events, at most 8
+ */
+#define _EV_SECOND      0   // Second boundary: time increment, 1-Hz rising edge
+#define _EV_HALF        1   // Half second: 1-Hz falling edge
+#define _EV_PULSE_END   2   // End of the interrupt output pulses
+#define _EV_I2C_STOP    3   // Poll for STOP after a time write, USI has no STOP interrupt
+#define _EV_PERSIST     4   // Registers quiet since the last write, save them to flash
+#define _EV_COUNT       5
+
+#define _EV_BIT(ev)     (1 << (ev))
+
+void _sched_init();
+void _sched_at(unsigned char event, unsigned short time);
+void _sched_post(unsigned char event, unsigned short ticks);
+unsigned char _sched_take_due();
+void _sched_arm();
+
+extern unsigned short _sched_time[_EV_COUNT];
+
+#endif /* TA_SCHEDULER_H_ */
@@ -4,20 +4,76 @@
  * HouYu Li <karajan_ii@hotmail.com>
  *
  * No license applied. Use as you wish.
+ *
+ * The USI holds SCL low from the end of each byte or ACK bit until
+ * USICNT is written again, so every cycle between interrupt entry and
+ * that write slows the bus down. Each state therefore writes the USI
+ * registers first, with plain writes, and does its bookkeeping while
+ * the next bits are on the wire:
+ *      - The byte to transmit is fetched one byte ahead, so sending
+ *        is a single copy once the master ACKs.
+ *      - A received byte is handed to the RX callback after its ACK,
+ *        while the following byte is being received. A non-zero return
+ *        from the callback therefore NACKs the following byte, the
+ *        callback decides on a byte before it arrives.
+ *      - A START that finds _USI_I2C_slave_hold set is left pending with
+ *        SCL held and the USI interrupts off, and _USI_I2C_slave_held()
+ *        asks the main loop for its work. USI_I2C_slave_resume() turns
+ *        the interrupts back on and the START is served as usual.
+ *
+ * States are even numbers for a jump table dispatch.
+ *
+ * Cost per interrupt in MCLK cycles, simulator cost model (sim/sim.h):
+ * entry and RETI 11, 4 per register access, 8 per call.
+ *                          to SCL release      total
+ *      START               27                  35 + reset_byte_count
+ *      Address, write      31                  31
+ *      Address, read       31                  39 + TX callback
+ *      RX first byte       23                  23
+ *      RX byte, ACK        31                  31
+ *      RX ACK sent         23                  31 + RX callback
+ *      TX byte             27                  35 + TX callback
+ *      TX ACK received     31                  39 + TX callback
+ *      TX NACK received    27                  27
+ *      TX wait ACKNACK     23                  23
+ *      Release             27                  27
+ *      START, held         held                31 + _USI_I2C_slave_held
+ * Worst case is 31 cycles with SCL held, a held START keeps SCL low
+ * until the main loop resumes it. Two interrupts are needed per
+ * byte, so at 1 MHz MCLK the bus runs at about 110 kHz whatever the
+ * master clock is. Run "rtc_sim i2c_rate" for the rate per MCLK.
  */
 
-#include <msp430.h>
+#include "hal.h"
 
+#include "config.h"
 #include "USI_I2C_slave.h"
 #include "functions.h"
 
-unsigned char _USI_I2C_slave_own_addr;
-unsigned char _USI_I2C_slave_state = 0;
+#define _USI_IDLE       0   // Not addressed, wait for START
+#define _USI_ADDR       2   // Address received, ACK or NACK it
+#define _USI_RX_FIRST   4   // Address ACK sent, receive the first byte
+#define _USI_RX_ACK     6   // Byte received, ACK or NACK it
+#define _USI_RX_NEXT    8   // ACK sent, receive next byte, hand over the last one
+#define _USI_TX_DATA    10  // Address ACK sent, send the first byte
+#define _USI_TX_ACK     12  // Byte sent, receive ACKNACK from master
+#define _USI_TX_CHECK   14  // ACKNACK received
+#define _USI_RELEASE    16  // NACK sent, release SDA
+#define _USI_RX_NACK    18  // Byte received after the RX callback refused one, NACK it
+
+#define _USI_SDA_IN     (USIPE6 + USIPE7)
+#define _USI_SDA_OUT    (USIPE6 + USIPE7 + USIOE)
+
+unsigned char _USI_I2C_slave_own_addr;      // Address byte with R/W bit 0 as seen on the bus
+unsigned char _USI_I2C_slave_state = _USI_IDLE;
 unsigned char _USI_I2C_slave_RX_buff;
+unsigned char _USI_I2C_slave_TX_next;       // Byte to send after the next ACK
+
+extern unsigned char _USI_I2C_slave_wake;   // Set by the callbacks when the main loop has work
+extern unsigned char _USI_I2C_slave_hold;   // Hold the next START for the main loop
 
 void USI_I2C_slave_init(unsigned char USI_I2C_slave_OA) {
-    _USI_I2C_slave_own_addr = USI_I2C_slave_OA; // Assign the slave own address to local variable
-                                                // The address should be a 7 bit address
+    _USI_I2C_slave_own_addr = USI_I2C_slave_OA << 1;    // The address should be a 7 bit address
 
     USICTL0 = (USIPE6 + USIPE7 + USISWRST); // Enable I2C pin & soft reset for USI module
     USICTL1 = (USII2C + USISTTIE + USIIE);  // Set I2C mode and enable related interrupt
@@ -30,84 +86,107 @@ void USI_I2C_slave_init(unsigned char USI_I2C_slave_OA) {
     __enable_interrupt();                   // Enable global interrupt
 }
 
+// Serve a START held for the main loop, nothing to do when none is held
+void USI_I2C_slave_resume() {
+    if (!(USICTL1 & USISTTIE))
+        USICTL1 |= USISTTIE + USIIE;        // The pending START interrupts right away
+}
+
 #pragma vector = USI_VECTOR
 __interrupt void USI_INT(void) {
-    if (USICTL1 & USISTTIFG) {              // Start condition detected
-        USICTL1 &= ~USISTP;                 // Force clear stop bit
-        USICNT &= ~0x1F;                    // Clear SR count
-        USISRL = 0x00;                      // Clear SR
-        USICTL1 &= ~USIIFG;                 // Clear interrupt flag again
-        _USI_I2C_slave_state = 2;           // Start in state 2
+    unsigned char byte;
+    _DIAG_ENTER();
+
+    if (_USI_I2C_slave_hold && (USICTL1 & USISTTIFG)) {    // Leave the START pending, SCL stays low
+        USICTL1 &= ~(USISTTIE + USIIE);
+        _USI_I2C_slave_held();
+        _USI_I2C_slave_wake = 1;
+    } else if (USICTL1 & USISTTIFG) {       // Start condition detected
+        USICTL0 = _USI_SDA_IN;              // SDA as input
+        USICNT = 0x08;                      // Receive the slave address
+        USICTL1 = (USII2C + USISTTIE + USIIE);  // Clear start, stop and interrupt flag, release SCL
+        _USI_I2C_slave_state = _USI_ADDR;
         _USI_I2C_slave_reset_byte_count();  // Clear data transaction byte count
+    } else {
+        switch (__even_in_range(_USI_I2C_slave_state, _USI_RX_NACK)) {
+        case _USI_IDLE:     // Do nothing
+            break;
+        case _USI_ADDR:     // Check received slave address
+            byte = USISRL;
+            if (byte == _USI_I2C_slave_own_addr) {              // Slave receiver
+                USISRL = 0x00;                  // Generate ACK
+                USICTL0 = _USI_SDA_OUT;
+                USICNT = 0x01;
+                _USI_I2C_slave_state = _USI_RX_FIRST;
+            } else if (byte == _USI_I2C_slave_own_addr + 1) {   // Slave transmitter
+                USISRL = 0x00;                  // Generate ACK
+                USICTL0 = _USI_SDA_OUT;
+                USICNT = 0x01;
+                _USI_I2C_slave_state = _USI_TX_DATA;
+                _USI_I2C_slave_TX_next = *(USI_I2C_slave_TX_callback());    // First byte
+            } else {                            // Slave address does not match
+                USISRL = 0xFF;                  // Generate NACK
+                USICTL0 = _USI_SDA_OUT;
+                USICNT = 0x01;
+                _USI_I2C_slave_state = _USI_RELEASE;
+            }
+            break;
+        case _USI_RX_FIRST: // Receive the first data byte
+            USICTL0 = _USI_SDA_IN;
+            USICNT = 0x08;
+            _USI_I2C_slave_state = _USI_RX_ACK;
+            break;
+        case _USI_RX_ACK:   // Data byte received, send ACK
+            _USI_I2C_slave_RX_buff = USISRL;
+            USISRL = 0x00;                      // Generate ACK
+            USICTL0 = _USI_SDA_OUT;
+            USICNT = 0x01;
+            _USI_I2C_slave_state = _USI_RX_NEXT;
+            break;
+        case _USI_RX_NACK:  // Data byte received, the last one was refused
+            USISRL = 0xFF;                      // Generate NACK
+            USICTL0 = _USI_SDA_OUT;
+            USICNT = 0x01;
+            _USI_I2C_slave_state = _USI_RELEASE;
+            break;
+        case _USI_RX_NEXT:  // ACK sent, receive the next byte and deal with this one meanwhile
+            USICTL0 = _USI_SDA_IN;
+            USICNT = 0x08;
+            _USI_I2C_slave_state = _USI_RX_ACK;
+            if (USI_I2C_slave_RX_callback(&_USI_I2C_slave_RX_buff))    // Error in data
+                _USI_I2C_slave_state = _USI_RX_NACK;
+            break;
+        case _USI_TX_CHECK: // Check received ACKNACK
+            if (USISRL & 0x01) {                // NACK received, release and prepare for another start
+                USICTL0 = _USI_SDA_IN;
+                USICTL1 &= ~USIIFG;
+                _USI_I2C_slave_state = _USI_IDLE;
+                break;
+            }
+            // Fall through - ACK received, go on sending data byte
+        case _USI_TX_DATA:  // Send data byte
+            USISRL = _USI_I2C_slave_TX_next;
+            USICTL0 = _USI_SDA_OUT;
+            USICNT = 0x08;
+            _USI_I2C_slave_state = _USI_TX_ACK;
+            _USI_I2C_slave_TX_next = *(USI_I2C_slave_TX_callback());    // Following byte
+            break;
+        case _USI_TX_ACK:   // Receive ACKNACK
+            USICTL0 = _USI_SDA_IN;
+            USICNT = 0x01;
+            _USI_I2C_slave_state = _USI_TX_CHECK;
+            break;
+        case _USI_RELEASE:  // Release and prepare for next start
+            USICTL0 = _USI_SDA_IN;
+            USICTL1 &= ~USIIFG;
+            _USI_I2C_slave_state = _USI_IDLE;
+            break;
+        }
     }
 
-    switch (_USI_I2C_slave_state) {
-    case 0: // Do nothing
-        break;
-    case 2: // Start of I2C transaction
-        USICTL0 &= ~USIOE;          // Disable output for receiving byte
-        USICNT |= 0x08;             // Receive the 1st byte, slave address
-        USICTL1 &= ~USISTTIFG;      // Clear start interrupt flag
-        _USI_I2C_slave_state = 3;   // Go to check slave address (state 3)
-        break;
-    case 3: // Check received slave address
-        if ((USISRL >> 1) != _USI_I2C_slave_own_addr) {     // Slave address does not match
-            USISRL = 0xff;              // Generate NACK
-            _USI_I2C_slave_state = 6;   // Release
-        } else {
-            if ((_USI_I2C_slave_own_addr << 1) == USISRL)   // Slave receiver
-                _USI_I2C_slave_state = 11;
-            else                                            // Slave transmitter
-                _USI_I2C_slave_state = 12;
-            USISRL = 0x00;              // Generate ACK
-        }
-        USICTL0 |= USIOE;   // Enable output
-        USICNT |= 0x01;     // Send ACKNACK
-        break;
-    case 6: // Release and prepare for next start
-        USICTL0 &= ~USIOE;          // Set SDA as input
-        USICTL1 &= ~USIIFG;         // Clear interrupt flag
-        _USI_I2C_slave_state = 0;   // Reset state
-        break;
-    case 11: // Receive data byte
-        USICTL0 &= ~USIOE;          // Set SDA as input
-        USICNT |= 0x08;             // Prepare for receiving 8 bits
-        _USI_I2C_slave_state = 13;  // Go to check received data and send ACKNACK
-        break;
-    case 12: // Send 1st data byte
-        USISRL = *(USI_I2C_slave_TX_callback());    // Get prepared data to be sent
-        USICTL0 |= USIOE;                           // Set SDA as output
-        USICNT |= 0x08;                             // Prepare for transmitting 8 bits
-        _USI_I2C_slave_state = 14;                  // Go to receive ACKNACK
-        break;
-    case 13: // Check received data and send ACKNACK
-        _USI_I2C_slave_RX_buff = USISRL;    // Copy byte from SR to local variable
-        if (!USI_I2C_slave_RX_callback(&_USI_I2C_slave_RX_buff)) {  // No error in data, returns 0
-            USISRL = 0x00;                  // Generate ACK
-            _USI_I2C_slave_state = 11;      // Go on receiving data
-        } else {
-            USISRL = 0xff;                  // Generate NACK
-            _USI_I2C_slave_state = 6;       // Do not continue the transaction
-        }
-        USICTL0 |= USIOE;                   // Set SDA as output
-        USICNT |= 0x01;                     // Prepare for transmitting 1 bit
-        break;
-    case 14: // Receive ACKNACK
-        USICTL0 &= ~USIOE;          // Set SDA as input
-        USICNT |= 0x01;             // Prepare for receiving 1 bit
-        _USI_I2C_slave_state = 15;  // Check received ACKNACK
-        break;
-    case 15: // Check received ACKNACK
-        if (USISRL & 1) {               // NACK received, release and prepare for another start
-            USICTL0 &= ~USIOE;          // Set SDA as input
-            USICTL1 &= ~USIIFG;         // Clear interrupt flag
-            _USI_I2C_slave_state = 0;   // Reset state
-        } else {                        // ACK received, go on send data byte
-            USISRL = *(USI_I2C_slave_TX_callback());    // Get prepared data to be sent
-            USICTL0 |= USIOE;                           // Set SDA as output
-            USICNT |= 0x08;                             // Prepare for transmitting 8 bits
-            _USI_I2C_slave_state = 14;                  // Go to receive ACKNACK
-        }
-        break;
+    if (_USI_I2C_slave_wake) {
+        _USI_I2C_slave_wake = 0;
+        __bic_SR_register_on_exit(LPM3_bits);   // Leave low power mode for the main loop
     }
+    _DIAG_EXIT(_DIAG_USI);
 }
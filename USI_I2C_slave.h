@@ -10,5 +10,6 @@
 #define USI_I2C_SLAVE_H_
 
 void USI_I2C_slave_init(unsigned char USI_I2C_slave_OA);
+void USI_I2C_slave_resume();
 
 #endif /* USI_I2C_SLAVE_H_ */
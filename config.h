@@ -9,15 +9,48 @@
 #ifndef CONFIG_H_
 #define CONFIG_H_
 
+/**
+ * RAM budget
+ * 256 bytes, 80 of them kept for the stack, leaves 176 for variables
+ *      Clock, I2C, scheduler and data store with 8 alarms  ~103
+ *      Each alarm over 8                                      3
+ *      _UART_OUTPUT with a 32 byte queue                     41
+ *      _TEMP_SAMPLES                                         2 per sample
+ *      _TEMP_HISTORY                                         5 + 4 per entry
+ *      _EVENT_LOG                                            4 + 4 per record
+ *      _PERSIST                                              4
+ *      _TRIM                                                 4
+ *      _TEMP_COMP                                            5
+ *      _TEMP_ALARM                                           3
+ *      _CAPTURE                                              5 + 4 per entry
+ *      _TIMERS                                               4 + 7 per timer
+ *      _DIAG                                                26 + 5 per ISR
+ * The defaults leave about 1 byte. Debug builds with _UART_OUTPUT
+ * need the history and the event log off or smaller.
+ */
+
 /**
  * Uncomment following line to enable UART output
  * Comment for release build
  */
-#define _UART_OUTPUT
+//#define _UART_OUTPUT
 #ifdef _UART_OUTPUT
 
 #define _UART_TXD    BIT2   // P1.2 as UART TXD
 
+/**
+ * Baud rate, 1200, 2400, 4800 or 9600
+ * Bits are timed on ACLK, so edges jitter by up to one ACLK count
+ * (30.5us, ~30% of a bit at 9600). Bit times are kept right on average.
+ */
+#define _UART_BAUD          9600
+
+/**
+ * Transmit queue size in bytes, power of 2
+ * One datetime line takes 18 bytes
+ */
+#define _UART_QUEUE_SIZE    32
+
 #endif
 
 /**
@@ -26,6 +59,84 @@
 #define _I2C_addr        0x41
 #define _I2C_addr_op1    0x43
 
+/**
+ * Number of alarms, 6~32
+ * Alarm1~6 are at the DS3231 style offsets 8~25, Alarm7 and up from offset 37
+ * Each alarm takes 3 bytes of RAM
+ */
+#define _ALARM_COUNT    8
+
+/**
+ * Samples per averaged temperature conversion, 2~64, power of 2
+ * Each sample takes 2 bytes of RAM. 8 samples give 1.5 extra bits.
+ */
+#define _TEMP_SAMPLES   8
+
+/**
+ * Entries of the periodic temperature history, 1~31
+ * Comment to leave periodic sampling out
+ */
+#define _TEMP_HISTORY   4
+
+/**
+ * Records of the event log, 1~63
+ * Comment to leave the event log out
+ */
+#define _EVENT_LOG      4
+
+/**
+ * Aging offset register at 0x7B to trim the crystal, see _trim_update()
+ * Comment to leave out
+ */
+#define _TRIM
+
+/**
+ * Temperature compensation of the crystal, minutes between samples
+ * Needs _TRIM. The turnover temperature and the curvature are at
+ * 0x7C and 0x7D, see _tcomp_update().
+ * Comment to leave out
+ */
+#define _TEMP_COMP      1
+
+/**
+ * Temperature thresholds with hysteresis at 0xEE~0xF0, see _temp_alarm()
+ * Their flags and enables are those of Alarm31 and Alarm32, so
+ * _ALARM_COUNT goes up to 30. Fits the RAM with _EVENT_LOG at 3.
+ * Uncomment to watch the temperature
+ */
+//#define _TEMP_ALARM
+
+/**
+ * Entries of the P1.2 edge capture FIFO, 1~63
+ * P1.2 is the UART TXD, so only without _UART_OUTPUT. Does not fit
+ * the RAM with the defaults, turn the history or the event log off.
+ * Uncomment to timestamp edges on P1.2, see _cap_byte()
+ */
+//#define _CAPTURE        4
+
+/**
+ * Countdown and periodic timers, 1~4, see _timer_fire()
+ * Two timers fit the RAM with _TEMP_HISTORY and _EVENT_LOG at 2.
+ * Uncomment to add the timers
+ */
+//#define _TIMERS         2
+
+/**
+ * Interrupt and main loop timing, read at 0xC0~, see _diag_byte()
+ * Three ISRs are timed, four with _UART_OUTPUT or _CAPTURE for Timer_A1.
+ * Fits the RAM with _TEMP_HISTORY and _EVENT_LOG off.
+ * Uncomment to instrument
+ */
+//#define _DIAG
+
+/**
+ * Keep alarms, enables, configuration, the history interval, the
+ * aging offset, the compensation curve and the temperature thresholds
+ * in information flash, restored at reset
+ * Comment to leave out
+ */
+#define _PERSIST
+
 /**
  * Day mask bit for alarm setting
  */
@@ -10,12 +10,97 @@
 #define FUNCTIONS_H_
 
 void _init_DS();
-void _check_leap_year();
+unsigned char _is_leap_year();
 void _time_increment();
+void _time_materialize();
+void _time_from_BCD();
+void _time_from_seconds(unsigned long seconds);
+void _time_commit();
+void _time_stage(unsigned char epoch, unsigned char i, unsigned char value);
+unsigned char * _time_byte(unsigned char offset);
+void _date_increment();
+unsigned char _to_BCD(unsigned char value);
+unsigned char _from_BCD(unsigned char bcd);
 void _time_carry(unsigned char * byte);
+unsigned char * _alarm_reg(unsigned char n);
+void _alarm_schedule();
 void _check_alarms();
-void _alarm_interrupt();
+unsigned char _alarm_interrupt();
 void _alarm_reset_interrupt();
+void _sqw_mode();
+void _clock_set(unsigned char fast);
+void _LPM3_sleep();
+void _temp_next();
+void _temp_start(unsigned char averaged);
+unsigned int _temp_result();
+unsigned int _temp_calibrate(unsigned int code);
+int _temp_celsius(unsigned int code);
+#if defined(_TEMP_HISTORY) || defined(_TEMP_COMP) || defined(_TEMP_ALARM)
+void _temp_periodic();
+#endif
+#ifdef _TEMP_ALARM
+void _temp_alarm();
+#endif
+#ifdef _TRIM
+void _trim_update();
+#endif
+#ifdef _TEMP_COMP
+void _tcomp_update(int celsius);
+#endif
+#ifdef _PERSIST
+unsigned char * _persist_reg(unsigned char i);
+unsigned char _persist_get(unsigned char i);
+void _persist_set(unsigned char i, unsigned char value);
+void _persist_restore();
+void _persist_flush();
+void _persist_compact();
+#endif
+#ifdef _EVENT_LOG
+void _log_event(unsigned char code);
+unsigned char * _log_byte(unsigned char offset);
+void _log_consume();
+#endif
+#ifdef _TIMERS
+unsigned long _timer_period(unsigned char n);
+void _timer_start();
+void _timer_fire();
+void _timer_schedule();
+#endif
+#ifdef _CAPTURE
+void _cap_mode(unsigned char mode);
+unsigned char * _cap_byte(unsigned char offset);
+void _cap_consume();
+#endif
+#ifdef _DIAG
+void _diag_isr(unsigned char n, unsigned short entry);
+void _diag_serviced(unsigned int bits);
+unsigned char * _diag_byte(unsigned char offset);
+void _diag_clear();
+#endif
+#ifdef _TEMP_HISTORY
+void _temp_history_add(unsigned int value);
+unsigned char * _temp_history_byte(unsigned char offset);
+#endif
+
+/**
+ * ISR timing, _DIAG_ENTER() first thing in an ISR, _DIAG_EXIT() on the way out
+ */
+#define _DIAG_TA0       0
+#define _DIAG_USI       1
+#define _DIAG_ADC10     2
+#define _DIAG_TA1       3
+#ifdef _DIAG
+#define _DIAG_ENTER()   unsigned short _diag_entry = TAR
+#define _DIAG_EXIT(n)   _diag_isr(n, _diag_entry)
+#else
+#define _DIAG_ENTER()
+#define _DIAG_EXIT(n)
+#endif
+
+void _i2c_seek(unsigned char offset);
+void _i2c_page_end();
+unsigned char _i2c_mapped(unsigned char offset);
+#define _I2C_ADVANCE()  do { if (++_I2C_data_offset == _I2C_end) _i2c_page_end(); } while (0)
 
 /***********************************************
  * Mandatory functions for callback
@@ -23,6 +108,7 @@ void _alarm_reset_interrupt();
 unsigned char * USI_I2C_slave_TX_callback();
 unsigned char USI_I2C_slave_RX_callback(unsigned char * byte);
 void _USI_I2C_slave_reset_byte_count();
+void _USI_I2C_slave_held();
 //**********************************************/
 
 #ifdef _UART_OUTPUT
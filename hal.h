@@ -0,0 +1,49 @@
+/*
+ * Hardware abstraction layer
+ *
+ * HouYu Li <karajan_ii@hotmail.com>
+ *
+ * No license applied. Use as you wish.
+ *
+ * All firmware sources include this file instead of <msp430.h>.
+ * On target it is a plain pass-through to the device header.
+ * When built with _HAL_HOST defined, the registers and intrinsics
+ * are provided by the host simulator in sim/ so the real ISRs can be
+ * driven from a virtual clock on a PC.
+ */
+
+#ifndef HAL_H_
+#define HAL_H_
+
+#ifdef _HAL_HOST
+
+#include "sim/msp430_host.h"
+
+#define main    _firmware_main          // The simulator owns the real main()
+
+/**
+ * Called once per main loop pass
+ * Lets the simulator account loop time and end the run
+ */
+#define _HAL_LOOP_POLL()    _sim_loop_poll()
+
+/**
+ * Bus address of a RAM object for the DTC, and the ADC10 TLV words
+ */
+#define _HAL_ADDR(p)        _sim_addr(p)
+#define _HAL_TLV_ADC10      _sim_TLV_ADC10
+#define _HAL_INFO           _sim_info
+
+#else
+
+#include <msp430.h>
+
+#define _HAL_LOOP_POLL()
+
+#define _HAL_ADDR(p)        ((unsigned int)(p))
+#define _HAL_TLV_ADC10      ((const unsigned int *)0x10DC)    // Follows TLV_ADC10_1_LEN
+#define _HAL_INFO           ((unsigned char *)0x1000)           // Information segment D
+
+#endif
+
+#endif /* HAL_H_ */
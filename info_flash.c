@@ -0,0 +1,52 @@
+/*
+ * Information flash access
+ *
+ * HouYu Li <karajan_ii@hotmail.com>
+ *
+ * No license applied. Use as you wish.
+ *
+ * The flash timing generator runs from MCLK. FCTL2 is set along with
+ * the CPU speed in _clock_set() so that it stays within 257~476 kHz.
+ *
+ * The CPU is held while the flash is busy, about 15ms for a segment
+ * erase and 90us per byte written. Interrupts are disabled meanwhile,
+ * events that fall due are served late but not lost as the timer keeps
+ * running. SCL is stretched if an I2C transfer comes in.
+ */
+
+#include "hal.h"
+
+#include "info_flash.h"
+
+/**
+ * Erase one information segment to 0xFF
+ */
+void _info_erase(unsigned char * segment) {
+    unsigned int sr;
+
+    sr = __get_SR_register();
+    __disable_interrupt();
+    FCTL3 = FWKEY;                      // Unlock, segment A stays locked with LOCKA
+    FCTL1 = FWKEY + ERASE;
+    *segment = 0;                       // Dummy write starts the erase
+    FCTL1 = FWKEY;
+    FCTL3 = FWKEY + LOCK;
+    __bis_SR_register(sr & GIE);
+}
+
+/**
+ * Program bytes into erased information flash
+ */
+void _info_write(unsigned char * dest, const unsigned char * src, unsigned char length) {
+    unsigned int sr;
+
+    sr = __get_SR_register();
+    __disable_interrupt();
+    FCTL3 = FWKEY;
+    FCTL1 = FWKEY + WRT;
+    while (length--)
+        *dest++ = *src++;
+    FCTL1 = FWKEY;
+    FCTL3 = FWKEY + LOCK;
+    __bis_SR_register(sr & GIE);
+}
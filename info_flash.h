@@ -0,0 +1,23 @@
+/*
+ * Information flash access
+ *
+ * HouYu Li <karajan_ii@hotmail.com>
+ *
+ * No license applied. Use as you wish.
+ */
+
+#ifndef INFO_FLASH_H_
+#define INFO_FLASH_H_
+
+#define _INFO_SEG_SIZE  64      // Bytes per information segment
+#define _INFO_SEG_COUNT 3       // Segments D, C and B. A holds the factory calibration
+
+/**
+ * Segment n, 0: D (0x1000), 1: C (0x1040), 2: B (0x1080)
+ */
+#define _INFO_SEG(n)    (_HAL_INFO + (n) * _INFO_SEG_SIZE)
+
+void _info_erase(unsigned char * segment);
+void _info_write(unsigned char * dest, const unsigned char * src, unsigned char length);
+
+#endif /* INFO_FLASH_H_ */
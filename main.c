@@ -8,29 +8,172 @@
  * Data structure is following DS3231.
  *
  * Port definition
- *      P1.0            1-Hz output
+ *      P1.0            1-Hz output, or ACLK or off, see _sqw_mode()
  *      P1.1, P1.2      Reserved for software UART (Transmit only)
+ *      P1.2            Edge capture input without UART, see _CAPTURE
  *      P1.3            I2C slave address pin
  *                      High:   0x41 (default)
  *                      Low:    0x43 (= 0x41 | 0x02)
  *      P1.4            Temperature convert finished interrupt output
- *      P1.5            Unison alarm interrupt output for all 6 alarms
+ *      P1.5            Unison alarm interrupt output for all alarms
  *      P1.6, P1.7      USI I2C mode
  *      P2.0            Individual alarm interrupt output for Alarm1
  *      P2.1            Individual alarm interrupt output for Alarm2
  *      P2.2            Individual alarm interrupt output for Alarm3
- *      P2.3            Active low logic for setting CPU speed at 8MHz
- *      P2.4            Active low logic for setting CPU speed at 12MHz
- *      P2.5            Active low logic for setting CPU speed at 16MHz
+ *      P2.3            Active low logic for a CPU speed ceiling of 8MHz
+ *      P2.4            Active low logic for a CPU speed ceiling of 12MHz
+ *      P2.5            Active low logic for a CPU speed ceiling of 16MHz
+ *                      MCLK runs at 1MHz otherwise, see _clock_set()
  */
 
-#include <msp430.h>
+#include "hal.h"
 
 #include "config.h"
 #include "functions.h"
 #include "USI_I2C_slave.h"
+#include "TA_scheduler.h"
+#include "info_flash.h"
 
-unsigned char _DATA_STORE[31];  // Data storage
+#define _DS_ALARM_EXT    37                                      // First byte of Alarm7
+#define _DS_SIZE        (_DS_ALARM_EXT + 3 * (_ALARM_COUNT - 6))
+#define _TIMER_BASE     0x64                                    // Timer window, 3 bytes per timer
+#define _CAP_BASE       0x70                                    // Edge capture window
+#define _CAP_STREAM     (_CAP_BASE + 2)                         // Edge capture stream register
+#define _UNIX_BASE      0x74                                    // Unix time window
+#define _SUBSEC_BASE    0x7E                                    // Fraction of the time snapshot
+#define _LOG_BASE       0x78                                    // Event log window
+#define _LOG_STREAM     (_LOG_BASE + 2)                         // Event log stream register
+#define _TRIM_BASE      0x7B                                    // Aging offset register
+#define _TCOMP_BASE     0x7C                                    // Compensation curve registers
+#define _HIST_BASE      0x80                                    // Temperature history window
+#define _DIAG_BASE      0xC0                                    // Diagnostics window
+#define _CELSIUS_BASE   0xEC                                    // Temperature in Celsius
+#define _TALARM_BASE    0xEE                                    // Temperature thresholds
+#define _PAGE_BANK      0xFF                                    // Bank select, in every page
+
+#define _PAGE_SELECT    (BIT2 + BIT1 + BIT0)    // Bank select register bits, see _i2c_seek()
+#define _PAGE_PAST      BIT6
+#define _PAGE_WRAP      BIT7
+
+#define _HOOK_NONE      0       // Written as is, see _REG_hook
+#define _HOOK_TIME      2
+#define _HOOK_ALARM     4
+#define _HOOK_CONFIG    6
+
+#define _PERSIST_MARK   0x5A    // First byte of a complete flash segment
+#define _PERSIST_CFG    (BIT7 + BIT3 + _SQW_MASK)   // Bits of register 28 that are kept
+#define _PERSIST_ALARMS (23 + 3 * (_ALARM_COUNT - 6))           // Alarms, configuration and enables
+#if defined(_TEMP_COMP) && !defined(_TRIM)
+#error "_TEMP_COMP needs _TRIM"
+#endif
+#ifdef _TEMP_COMP
+#define _PERSIST_TRIM   3
+#elif defined(_TRIM)
+#define _PERSIST_TRIM   1
+#else
+#define _PERSIST_TRIM   0
+#endif
+#ifdef _TEMP_HISTORY
+#define _PERSIST_HIST   1
+#else
+#define _PERSIST_HIST   0
+#endif
+#ifdef _TEMP_ALARM
+#define _PERSIST_TALARM 3
+#else
+#define _PERSIST_TALARM 0
+#endif
+#define _PERSIST_COUNT  (_PERSIST_ALARMS + _PERSIST_TRIM + _PERSIST_HIST + _PERSIST_TALARM)
+#if defined(_PERSIST) && _PERSIST_COUNT > 58
+#error "An information segment holds at most 58 registers, lower _ALARM_COUNT"
+#endif
+#define _PERSIST_HEAD   4       // Mark, sequence number and layout before the registers
+#ifdef _TRIM
+#define _PERSIST_F_TRIM     BIT0
+#else
+#define _PERSIST_F_TRIM     0
+#endif
+#ifdef _TEMP_COMP
+#define _PERSIST_F_TCOMP    BIT1
+#else
+#define _PERSIST_F_TCOMP    0
+#endif
+#ifdef _TEMP_HISTORY
+#define _PERSIST_F_HIST     BIT2
+#else
+#define _PERSIST_F_HIST     0
+#endif
+#ifdef _TEMP_ALARM
+#define _PERSIST_F_TALARM   BIT3
+#else
+#define _PERSIST_F_TALARM   0
+#endif
+#define _PERSIST_FEATURES   (_PERSIST_F_TRIM + _PERSIST_F_TCOMP + _PERSIST_F_HIST + _PERSIST_F_TALARM)
+
+#if _TEMP_SAMPLES < 2 || _TEMP_SAMPLES > 64 || (_TEMP_SAMPLES & (_TEMP_SAMPLES - 1))
+#error "_TEMP_SAMPLES is a power of 2 from 2 to 64, the sum is scaled by 64 / _TEMP_SAMPLES"
+#endif
+#if defined(_TEMP_ALARM) && _ALARM_COUNT > 30
+#error "Alarm31 and Alarm32 flags are the temperature thresholds, lower _ALARM_COUNT to 30"
+#endif
+#if defined(_CAPTURE) && defined(_UART_OUTPUT)
+#error "_CAPTURE and _UART_OUTPUT both need P1.2 and TACCR1"
+#endif
+#if defined(_CAPTURE) && _DS_SIZE > _CAP_BASE
+#error "Alarms run into the edge capture window, lower _ALARM_COUNT to 29"
+#endif
+
+#if defined(_DIAG) && defined(_TEMP_HISTORY) && _HIST_BASE + 2 + 4 * _TEMP_HISTORY > _DIAG_BASE
+#error "The history runs into the diagnostics window, lower _TEMP_HISTORY to 15"
+#endif
+#if defined(_DIAG) && (defined(_UART_OUTPUT) || defined(_CAPTURE))
+#define _DIAG_ISRS      4       // Timer_A1 as well
+#else
+#define _DIAG_ISRS      3
+#endif
+
+#if defined(_TIMERS) && _DS_SIZE > _TIMER_BASE
+#error "Alarms run into the timer window, lower _ALARM_COUNT to 27"
+#endif
+
+#define _CLK_CEILING    (BIT1 + BIT0)   // _CLK_state: strap ceiling, 0: 1MHz, 1: 8MHz, 2: 12MHz, 3: 16MHz
+#define _CLK_I2C        BIT6            // I2C transaction since START, hold the ceiling until STOP
+#define _CLK_FAST       BIT7            // MCLK at the ceiling
+
+#define _SQW_MASK       (BIT1 + BIT0)   // Square wave select in register 28, see _sqw_mode()
+#define _SQW_1HZ        0
+#define _SQW_ACLK       BIT0
+
+#define _TIMER_ON       BIT7    // Timer control bits
+#define _TIMER_PERIODIC BIT6
+#define _TIMER_MINUTES  BIT5
+#define _TIMER_FIRED    BIT4
+#define _TIMER_START    BIT2
+#define _TIMER_P1_4     BIT1
+#define _TIMER_P1_5     BIT0
+
+#define _UNIX_2000      946684800UL     // Unix time of 2000-01-01 00:00:00
+#define _TIME_UNIX      0x0F00          // Bits of _TIME_stage_mask for the Unix time bytes
+
+#define _LOG_POWER_UP   0x01    // Event codes
+#define _LOG_TIME_SET   0x02
+#define _LOG_TEMP_HIGH  0x03
+#define _LOG_TEMP_LOW   0x04
+#define _LOG_TIMER      0x10    // + timer number - 1
+#define _LOG_ALARM      0x20    // + alarm number - 1
+
+#define _TEMP_HOST      BIT0    // Converting for the host, result to bytes 26/27
+#define _TEMP_SAMPLE    BIT1    // Converting a periodic sample, result to the history
+#define _TEMP_DUE       BIT2    // History sample waits for the ADC10
+#define _TEMP_COMP_DUE  BIT3    // Compensation sample waits for the ADC10
+#define _TEMP_READ      BIT4    // Host read the high byte of the result
+#define _TEMP_ALARM_DUE BIT5    // Threshold sample waits for the ADC10
+#define _TEMP_HIGH      BIT6    // At or above the high threshold, also its flag and enable bit
+#define _TEMP_LOW       BIT7    // Below the low threshold, also its flag and enable bit
+#define _TEMP_DUE_ANY   (_TEMP_DUE + _TEMP_COMP_DUE + _TEMP_ALARM_DUE)
+#define _TEMP_NONE      (-32767 - 1)    // _TEMP_celsius before the first sample, reads 0x8000
+
+unsigned char _DATA_STORE[_DS_SIZE];    // Data storage
                                 // 0: RTC second in BCD
                                 // 1: RTC minute in BCD
                                 // 2: RTC hour in BCD 24-hour format
@@ -44,53 +187,278 @@ unsigned char _DATA_STORE[31];  // Data storage
                                 // 11~25: Same as 8~10 for Alarm2~Alarm6
                                 // 26: High parts of temperature
                                 // 27: Low parts of temperature
+                                    // Single conversion: raw ADC10MEM
+                                    // Averaged conversion: calibrated code in 10.6 fixed point
                                 // 28: Reserved for general configuration
                                     // BIT7: Dedicated interrupt output for Alarm1~3
                                     // BIT6: Start temperature convert bit
-                                    // BIT5: Temperature convert finished flag
-                                // 29: Alarm interrupt enable bits
-                                // 30: Alarm interrupt flags
+                                    // BIT5: Temperature convert finished flag, cleared with 0
+                                    // BIT4: Commit staged time now, reads as 0
+                                    // BIT3: Averaged conversion of _TEMP_SAMPLES samples
+                                    // BIT1~0: P1.0 square wave, see _sqw_mode()
+                                // 29: Alarm interrupt enable bits for Alarm1~8
+                                // 30: Alarm interrupt flags for Alarm1~8, cleared with 0
+                                // 31~33: Alarm interrupt enable bits for Alarm9~32
+                                // 34~36: Alarm interrupt flags for Alarm9~32, cleared with 0
+                                    // Alarm31, 32: temperature thresholds with _TEMP_ALARM
+                                // 37~: Same as 8~10 for Alarm7 and up
+                                // 0x64~: Timers, 3 bytes each, see _timer_fire()
+                                // 0x70~0x73: Edge capture window, see _cap_byte()
+                                // 0x74~0x77: Unix time, little endian, see _time_byte()
+                                // 0x78~0x7A: Event log window, see _log_byte()
+                                // 0x7B: Aging offset, see _trim_update()
+                                // 0x7C, 0x7D: Compensation curve, see _tcomp_update()
+                                // 0x7E, 0x7F: Fraction of the second of the last time read in 1/32768s, MSB first
+                                // 0x80~: Temperature history window, see _temp_history_byte()
+                                // 0xC0~0xEB: Diagnostics, see _diag_byte()
+                                // 0xEC, 0xED: Last temperature in Celsius, see _temp_result()
+                                // 0xEE~0xF0: Temperature thresholds, see _temp_alarm()
+                                // 0xFF: Bank select, see _i2c_seek()
+
+const unsigned int _second_div = 32768;     // ACLK counts per second
+const unsigned int _half_second = 16384;    // ACLK counts per half second, 1-Hz output edges
+const unsigned int _pulse_ticks = 8192;     // Interrupt output pulse width, 0.25s
+const unsigned int _stop_poll_ticks = 33;   // Polling period for I2C STOP after a time write, ~1ms
+const unsigned int _persist_ticks = 32000;  // Quiet time after a register write before saving, ~1s
+
+unsigned long _RTC_seconds = 0;             // The clock: binary seconds since 2000-01-01 00:00:00
+unsigned int _RTC_day = 0;                  // Days since 2000-01-01, kept along with _RTC_seconds
+unsigned int _RTC_minute = 0;               // Minute of the day, 0~1439
+unsigned char _RTC_second = 0;              // Second of the minute, 0~59
+unsigned short _RTC_tick = 0;               // Timer count the last second started at
+
+/**
+ * Days before each month in a common year
+ */
+const unsigned int _days_before_month[12] = {
+    0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334
+};
 
-const unsigned int _second_div = 2048;      // 1/16 of 1-Hz with a bit tuning
-unsigned int _second_tick = 0;              // Ticker for a second
-unsigned char _is_leap_year = 0;            // Leap year indicator
+unsigned int _ALARM_next_day = 0xFFFF;      // Day number of the next alarm firing, 0xFFFF: none
+unsigned int _ALARM_next_minute = 0;        // Minute of the day of the next alarm firing
+unsigned long _ALARM_next_mask = 0;         // Alarms firing at that minute, BIT0: Alarm1
 
 unsigned char _I2C_data_offset = 0;         // Offset for data accessing in I2C
+unsigned char _I2C_TX_last = 0xFF;          // Offset fetched by the last TX callback, 0xFF: none
+unsigned char _I2C_page = 0;                // Bank select register, see _i2c_seek()
+unsigned char _I2C_end = _PAGE_BANK;        // Offset past the end of the page being accessed
+unsigned char _TIME_buff[8];                // Time bytes 0~7 or the Unix time, staged host writes
+                                            // or the time at START for reads, see _time_byte()
+                                            // Never both: a START is held until staged bytes are committed
+unsigned short _TIME_frac = 0;              // ACLK counts into the second at START
+unsigned char _TIME_sub[2];                 // _TIME_frac of the last time read, MSB first
+unsigned char _TIME_out;                    // Time byte worked out for the TX callback
+unsigned int _TIME_stage_mask = 0;          // One bit per byte in _TIME_buff written by host
+                                            // BIT0~7: bytes 0~7, BIT8~11: Unix time bytes
+
+unsigned char _CLK_state = 0;               // CPU speed, see _clock_set()
 
 unsigned char _RTC_action_bits = 0x00;      // For marking actions in interrupt
                                             // and run the action in the main loop
+                                            // An ISR posting any bit wakes the CPU from LPM3
 unsigned char _RTC_action_bits2 = 0x00;     // The extended action bits
+                                            // BIT3: Commit staged time registers
+                                            // BIT4: Start temperature convert
+                                            // BIT5: Alarm registers written, rebuild the alarm index
+                                            // BIT6: Register written, restart the save timer
+                                            // BIT7: Save registers to flash
+
+#if defined(_HAL_HOST) || defined(_DIAG)
+unsigned long _RES_active = 0;              // ACLK counts spent with CPU on in the main loop
+unsigned long _RES_LPM3 = 0;                // ACLK counts spent sleeping in LPM3
+unsigned short _RES_mark = 0;               // Timer count of the last mode change
+#endif
+#ifdef _DIAG
+unsigned short _DIAG_calls[_DIAG_ISRS];     // Entries of each ISR, wraps
+unsigned short _DIAG_ticks[_DIAG_ISRS];     // ACLK counts spent in each ISR, wraps
+unsigned char _DIAG_max[_DIAG_ISRS];        // Longest run of each ISR, saturates
+unsigned char _DIAG_wait[16];               // Longest wake to service of each action bit, saturates
+#endif
+
+unsigned short _TEMP_block[_TEMP_SAMPLES];      // Averaged conversion, filled by the ADC10 DTC
+unsigned char _TEMP_state = 0;                  // Who the ADC10 converts for, _TEMP_xxx bits
+int _TEMP_celsius = _TEMP_NONE;                 // Last sample in Celsius, 8.8 fixed point
+
+#ifdef _TEMP_HISTORY
+unsigned char _HIST_ring[_TEMP_HISTORY * 4];    // Entries as sent: minute stamp and value, MSB first
+unsigned char _HIST_tail = 0;                   // Oldest entry
+unsigned char _HIST_count = 0;                  // Entries held
+unsigned char _HIST_taken = 0;                  // Entries read in this transaction, dropped at next START
+unsigned char _HIST_interval = 0;               // Sample interval in minutes, 0: off
+unsigned char _HIST_countdown = 0;              // Minutes to the next sample
+#endif
+
+#ifdef _EVENT_LOG
+unsigned char _LOG_ring[_EVENT_LOG * 4];        // Records as sent: code, seconds stamp MSB first
+unsigned char _LOG_tail = 0;                    // Oldest record
+unsigned char _LOG_count = 0;                   // Records held
+unsigned char _LOG_pos = 0;                     // Bytes of the oldest record read
+                                                // BIT7: byte fetched for the stream is real
+unsigned char _LOG_lost = 0;                    // Records dropped with the log full, saturates
+#endif
+
+#ifdef _TRIM
+signed char _TRIM_aging = 0;                    // Aging offset register, 1/256 ACLK count per second
+int _TRIM_rate = 0;                             // Counts added to each second, 8.8 fixed point
+unsigned char _TRIM_frac = 0;                   // Fraction of ACLK count carried to the next second
+#endif
+
+#ifdef _TEMP_COMP
+signed char _TCOMP_turnover = 25;               // Turnover temperature in Celsius
+unsigned char _TCOMP_curve = 34;                // Curvature in 0.001ppm per Celsius squared
+int _TRIM_temp = 0;                             // Compensation part of _TRIM_rate
+unsigned char _TCOMP_countdown = 1;             // Minutes to the next sample, first one after a minute
+#endif
+
+#ifdef _TEMP_ALARM
+unsigned char _TALARM_reg[3] = { 0x7F, 0x80, 2 };  // High, low threshold and hysteresis, see _temp_alarm()
+#endif
+
+#ifdef _TIMERS
+unsigned char _TIMER_reg[_TIMERS * 3];          // Period LSB, MSB, control of each timer
+unsigned long _TIMER_due[_TIMERS];              // Second each running timer fires at
+unsigned long _TIMER_next = 0xFFFFFFFF;         // Earliest of them
+#endif
+
+#ifdef _CAPTURE
+unsigned char _CAP_ring[_CAPTURE * 4];          // Entries as sent: seconds and fraction, MSB first
+unsigned char _CAP_tail = 0;                    // Oldest entry
+unsigned char _CAP_count = 0;                   // Entries held
+unsigned char _CAP_pos = 0;                     // Bytes of the oldest entry read
+                                                // BIT7: byte fetched for the stream is real
+unsigned char _CAP_lost = 0;                    // Edges dropped with the FIFO full, saturates
+unsigned char _CAP_edges = 0;                   // Edges captured: 0 off, 1 rising, 2 falling, 3 both
+#endif
+
+#ifdef _PERSIST
+unsigned char _PERSIST_seg = 0xFF;              // Information segment in use, 0xFF: none valid
+unsigned char _PERSIST_free = 0;                // Offset of the next free record in it
+#endif
+
+const unsigned char _I2C_pad = 0xFF;            // Sent for bytes that do not exist
 
-unsigned char _RTC_byte_l = 0, _RTC_byte_h = 0; // For calculation use
-unsigned int _TEMP_data = 0;                    // For holder temperature result data
-unsigned char _TEMP_data_user_read = 0;         // Temperature data read by user
+/**
+ * Host writes to the data store, bytes 0~36. Alarm7 and up are as Alarm1.
+ * _REG_keep: Read only bits
+ * _REG_clear: Bits the host can clear with 0 but not set
+ * _REG_hook: What else a write does
+ *      _HOOK_TIME: Staged until STOP, see _time_stage()
+ *      _HOOK_ALARM: Rebuilds the alarm index
+ *      _HOOK_CONFIG: Commit, temperature convert and square wave of byte 28
+ */
+#define _REG_TIME       _HOOK_TIME, _HOOK_TIME, _HOOK_TIME, _HOOK_TIME
+#define _REG_ALARM      _HOOK_ALARM, _HOOK_ALARM, _HOOK_ALARM
+const unsigned char _REG_keep[_DS_ALARM_EXT] = {
+    0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0xFF, 0xFF,         // 26, 27: Temperature
+    0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+const unsigned char _REG_clear[_DS_ALARM_EXT] = {
+    0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0,
+    BIT5,               // 28: Temperature convert finished flag
+    0, 0xFF,            // 30: Alarm interrupt flags
+    0, 0, 0,
+    0xFF, 0xFF, 0xFF    // 34~36: Alarm interrupt flags
+};
+const unsigned char _REG_hook[_DS_ALARM_EXT] = {
+    _REG_TIME, _REG_TIME,
+    _REG_ALARM, _REG_ALARM, _REG_ALARM, _REG_ALARM, _REG_ALARM, _REG_ALARM,
+    _HOOK_NONE, _HOOK_NONE,
+    _HOOK_CONFIG,
+    _HOOK_NONE, _HOOK_NONE, _HOOK_NONE, _HOOK_NONE,
+    _HOOK_NONE, _HOOK_NONE, _HOOK_NONE, _HOOK_NONE
+};
+
+/**
+ * Register pages, see _i2c_seek()
+ * Each page shows a range of the offsets above from its offset 0.
+ * Pages of features left out are empty.
+ */
+const unsigned char _PAGE_base[8] = {
+    0,                  // 0: Everything, as without pages
+    8,                  // 1: Alarms, temperature, configuration, enables and flags
+    _TIMER_BASE,        // 2: Timers
+    _LOG_BASE,          // 3: Event log
+    _CAP_BASE,          // 4: Edge capture
+    _TRIM_BASE,         // 5: Calibration, aging offset and compensation curve
+    _HIST_BASE,         // 6: Temperature history
+    _DIAG_BASE          // 7: Diagnostics
+};
+const unsigned char _PAGE_size[8] = {
+    _PAGE_BANK,
+    _DS_SIZE - 8,
+#ifdef _TIMERS
+    _TIMERS * 3,
+#else
+    0,
+#endif
+#ifdef _EVENT_LOG
+    3,
+#else
+    0,
+#endif
+#ifdef _CAPTURE
+    4,
+#else
+    0,
+#endif
+    _PERSIST_TRIM,      // Same registers as kept in flash
+#ifdef _TEMP_HISTORY
+    2 + 4 * _TEMP_HISTORY,
+#else
+    0,
+#endif
+#ifdef _DIAG
+    44
+#else
+    0
+#endif
+};
 
 /***********************************************
  * Callback related variables (Mandatory)
  * Do not change the variable name
  ***********************************************/
 unsigned char _USI_I2C_slave_n_byte = 0;
+unsigned char _USI_I2C_slave_wake = 0;      // Set by callbacks to wake the main loop
+unsigned char _USI_I2C_slave_hold = 0;      // Time bytes staged, hold the next START until committed
 //**********************************************/
 
 // If software UART output enabled
 #ifdef _UART_OUTPUT
 /**
- * Following value come from sample code of TI
+ * Bit period in ACLK counts, 8.8 fixed point
+ * The fraction is carried from bit to bit so the error does not add up
  */
-const unsigned int _UART_period_1200 = 0x1B;    // 27, period for generating 1200 baud rate for UART based on 32768-Hz
-unsigned char _UART_n_bit;                      // Number of bits for each transmit
-unsigned int _UART_TX_data;                     // Data buffer for UART TX
+const unsigned int _UART_period = (unsigned int)((32768UL * 256 + _UART_BAUD / 2) / _UART_BAUD);
+unsigned char _UART_frac = 0;                   // Fraction of ACLK count carried to the next bit
+unsigned char _UART_n_bit = 0;                  // Bits left of the byte on the wire, 8data + ST/SP
+unsigned int _UART_TX_data;                     // Byte on the wire with start and stop bits
+unsigned char _UART_queue[_UART_QUEUE_SIZE];    // Bytes waiting for transmit
+unsigned char _UART_head = 0;                   // Next free slot, written by main loop only
+unsigned char _UART_tail = 0;                   // Next byte to send, written by Timer_A1 only
+unsigned char _UART_peak = 0;                   // Highest number of bytes queued
+unsigned int _UART_dropped = 0;                 // Bytes dropped with the queue full, saturates
 #endif
 
 /*
  * main.c
  */
 void main(void) {
+    unsigned int temp;
+#ifdef _DIAG
+    unsigned int pending = 0;
+#endif
+
     WDTCTL = WDTPW | WDTHOLD;   // Stop watchdog timer
 
-    // Set MCLK and SMCLK
+    // Set MCLK and SMCLK, 1MHz is the floor the CPU speed returns to
     BCSCTL1 = CALBC1_1MHZ;
     DCOCTL = CALDCO_1MHZ;
+    FCTL2 = FWKEY + FSSEL_1 + FN1;  // Flash timing from MCLK / 3, 333kHz
 
     // Set P1.0 to output 1-Hz
     P1DIR |= BIT0;              // P1.0 as output
@@ -108,25 +476,22 @@ void main(void) {
     P2DIR |= (BIT0 + BIT1 + BIT2);  // Set P2.0~P2.2 as dedicated output for alarm1~3
     P2OUT &= ~(BIT0 + BIT1 + BIT2); // Default low
 
-    // Set CPU speed based on P2 connection
-    if (!(P2IN & BIT3)) {           // P2.3 low, set CPU speed at 8MHz
-        BCSCTL1 = CALBC1_8MHZ;
-        DCOCTL = CALDCO_8MHZ;
-    }
-    if (!(P2IN & BIT4)) {           // P2.4 low, set CPU speed at 12MHz
-        BCSCTL1 = CALBC1_12MHZ;
-        DCOCTL = CALDCO_12MHZ;
-    }
-    if (!(P2IN & BIT5)) {           // P2.5 low, set CPU speed at 16MHz
-        BCSCTL1 = CALBC1_16MHZ;
-        DCOCTL = CALDCO_16MHZ;
-    }
+    // Set CPU speed ceiling based on P2 connection
+    if (!(P2IN & BIT3))             // P2.3 low, up to 8MHz
+        _CLK_state = 1;
+    if (!(P2IN & BIT4))             // P2.4 low, up to 12MHz
+        _CLK_state = 2;
+    if (!(P2IN & BIT5))             // P2.5 low, up to 16MHz
+        _CLK_state = 3;
 
 #ifdef _UART_OUTPUT
     // Setup P1.2 for TXD
     P1SEL |= _UART_TXD;         // P1.2 as TA0.1 out1
     P1DIR |= _UART_TXD;         // P1.2 is output pin
 #endif
+#ifdef _CAPTURE
+    P1SEL |= BIT2;              // P1.2 as TA0.1 CCI1A, input
+#endif
 
     // Configure for ACLK, no division applied
     BCSCTL3 |= XCAP_3;          // BCSCTL3 |= 0x0C;
@@ -135,13 +500,12 @@ void main(void) {
     // Setup Timer
     TACTL |= (TASSEL_1 + MC_2); // TASSELx = 01, using ACLK as source
                                 // MCx = 02, continuous mode
-#ifdef _UART_OUTPUT
-    TACTL |= TAIE;              // TAIE, enable overflow interrupt
-#endif
 
-    TACCR0 = _second_div;       // The timer clock is 32768-Hz
-                                // _second_div is 32768-Hz / 16
-                                // so that we have enough space for doing different actions
+    // TACCR0 only fires for the next scheduled event
+    _sched_init();
+    _sched_at(_EV_HALF, _half_second);
+    _sched_at(_EV_SECOND, _second_div);
+    _sched_arm();
     TACCTL0 |= CCIE;            // Enable timer capture interrupt
 
 #ifdef _UART_OUTPUT
@@ -151,8 +515,19 @@ void main(void) {
 
     // Initialize data store values
     _init_DS();
-    // Check leap year with initial data
-    _check_leap_year();
+#ifdef _PERSIST
+    // Alarms and configuration as saved
+    _persist_restore();
+#endif
+#ifdef _TRIM
+    _trim_update();
+#endif
+    _sqw_mode();
+    // Nothing armed yet, but keep the index consistent
+    _alarm_schedule();
+#ifdef _EVENT_LOG
+    _log_event(_LOG_POWER_UP);
+#endif
 
     // Prepare the ADC10 for temperature
     // From TI's sample code
@@ -165,19 +540,67 @@ void main(void) {
     else
         USI_I2C_slave_init(_I2C_addr_op1);
 
+#if defined(_HAL_HOST) || defined(_DIAG)
+    _RES_mark = TAR;
+#endif
     __enable_interrupt();
 
     while(1) {
+        _HAL_LOOP_POLL();
+#ifdef _DIAG
+        _diag_serviced(pending & ~(_RTC_action_bits | (_RTC_action_bits2 << 8)));
+#endif
+        // Sleep in LPM3 until an ISR posts work
+        // Interrupts stay disabled between the check and going to sleep
+        __disable_interrupt();
+        if (!(_RTC_action_bits | _RTC_action_bits2)) {
+            if (!(_CLK_state & _CLK_I2C) || (USICTL1 & USISTP)) {
+                _CLK_state &= ~_CLK_I2C;    // Bus released, back to the floor
+                _clock_set(0);
+            }
+            _LPM3_sleep();
+        } else {
+            if ((_RTC_action_bits & BIT6) || (_RTC_action_bits2 & BIT3))
+                _clock_set(1);          // Calibration or date arithmetic ahead
+            __enable_interrupt();
+        }
+#ifdef _DIAG
+        pending = _RTC_action_bits | (_RTC_action_bits2 << 8);
+#endif
+
+        if (_RTC_action_bits2 & BIT3) { // Time written by host, goes before the increment
+            _RTC_action_bits2 &= ~BIT3;
+            _time_commit();
+            USI_I2C_slave_resume();     // A START waiting for the commit goes on
+        }
+        if (_RTC_action_bits2 & BIT5) { // Alarm written by host, also before the increment
+            _RTC_action_bits2 &= ~BIT5;
+            _alarm_schedule();
+        }
+#ifdef _TIMERS
+        if (_RTC_action_bits & BIT7) {  // Timer control written, start or stop
+            _RTC_action_bits &= ~BIT7;
+            _timer_start();
+        }
+#endif
         if (_RTC_action_bits & BIT0) {  // The main timer increment
             _time_increment();
             _RTC_action_bits &= ~BIT0;
+#ifdef _TIMERS
+            if (_RTC_seconds == _TIMER_next)
+                _timer_fire();
+#endif
         }
         if (_RTC_action_bits & BIT3) {  // Check alarm logic
             _check_alarms();
+#if defined(_TEMP_HISTORY) || defined(_TEMP_COMP) || defined(_TEMP_ALARM)
+            _temp_periodic();           // Once a minute as well
+#endif
             _RTC_action_bits &= ~BIT3;
         }
         if (_RTC_action_bits & BIT4) {  // Check alarm interrupt
-            _alarm_interrupt();
+            if (_alarm_interrupt())
+                _sched_post(_EV_PULSE_END, _pulse_ticks);
             _RTC_action_bits &= ~BIT4;
         }
         if (_RTC_action_bits & BIT5) {  // Reset alarm interrupt output
@@ -190,27 +613,55 @@ void main(void) {
             _RTC_action_bits &= ~BIT1;
         }
 #endif
-        if (_DATA_STORE[28] & BIT6) {   // Temperature convert start bit is set
-            ADC10CTL0 |= ENC + ADC10SC; // Start convert temperature
-            _DATA_STORE[28] &= ~BIT6;   // Clear the start bit
+        if (_RTC_action_bits2 & BIT4) { // Temperature convert start bit is set
+            _temp_next();               // Starts now or after the conversion running
+            _RTC_action_bits2 &= ~BIT4;
         }
         if (_RTC_action_bits & BIT6) {  // Go on transfer temperature data
-            ADC10CTL0 &= ~ENC;          // Manually clear ADC convert bit
-            _TEMP_data = ADC10MEM;
-            _DATA_STORE[26] = (char)(_TEMP_data >> 8);
-            _DATA_STORE[27] = (char)_TEMP_data;
-            _DATA_STORE[28] |= BIT5;    // Temperature data ready for access
             _RTC_action_bits &= ~BIT6;
+            temp = _temp_result();
+#ifdef _TEMP_ALARM
+            _temp_alarm();
+#endif
+            if (_TEMP_state & _TEMP_SAMPLE) {   // Periodic sample, for whoever asked
+#ifdef _TEMP_HISTORY
+                if (_TEMP_state & _TEMP_DUE)
+                    _temp_history_add(temp);
+#endif
+#ifdef _TEMP_COMP
+                if (_TEMP_state & _TEMP_COMP_DUE)
+                    _tcomp_update(_TEMP_celsius);
+#endif
+                _TEMP_state &= ~_TEMP_DUE_ANY;
+            } else {
+                _DATA_STORE[26] = (char)(temp >> 8);
+                _DATA_STORE[27] = (char)temp;
+                _DATA_STORE[28] |= BIT5;    // Temperature data ready for access
+            }
+            _TEMP_state &= ~(_TEMP_HOST + _TEMP_SAMPLE);
+            _temp_next();
         }
         if (_RTC_action_bits2 & BIT0) {
-            if (_DATA_STORE[28] & BIT5) // If temperature data is ready, we trigger interrupt
+            if (_DATA_STORE[28] & BIT5) {   // If temperature data is ready, we trigger interrupt
                 P1OUT |= BIT4;
+                _sched_post(_EV_PULSE_END, _pulse_ticks);
+            }
             _RTC_action_bits2 &= ~BIT0;
         }
         if (_RTC_action_bits2 & BIT1) { // Reset temperature finish interrupt output
             P1OUT &= ~BIT4;
             _RTC_action_bits2 &= ~BIT1;
         }
+#ifdef _PERSIST
+        if (_RTC_action_bits2 & BIT6) { // Register written, save once the host is done
+            _RTC_action_bits2 &= ~BIT6;
+            _sched_post(_EV_PERSIST, _persist_ticks);
+        }
+        if (_RTC_action_bits2 & BIT7) { // Quiet for a while, save now
+            _RTC_action_bits2 &= ~BIT7;
+            _persist_flush();
+        }
+#endif
     }
 }
 
@@ -231,56 +682,264 @@ void _init_DS() {
 
 /**
  * Check whether current year is leap year
+ * Worked out from bytes 6~7 when needed, twice a day at most
  */
-void _check_leap_year() {
-    // Reset leap year indicator first
-    _is_leap_year = 0;
+unsigned char _is_leap_year() {
+    unsigned char byte_l;
 
-    _RTC_byte_l = _DATA_STORE[6] << 4;
-    if (_DATA_STORE[6] & 0x10) {
-        if (_RTC_byte_l == 0x20 || _RTC_byte_l == 0x60)
-            _is_leap_year = 1;
-    } else {
-        if (_RTC_byte_l == 0x40 || _RTC_byte_l == 0x80)
-            _is_leap_year = 1;
-    }
+    // Year 00 is leap only in a century dividable by 4
+    if (_DATA_STORE[6] == 0x00 && (_DATA_STORE[7] & 0x01))
+        return 0;
+    byte_l = _DATA_STORE[6] << 4;
+    if (_DATA_STORE[6] & 0x10)
+        return byte_l == 0x20 || byte_l == 0x60;
+    return byte_l == 0x00 || byte_l == 0x40 || byte_l == 0x80;
 }
 
 /**
  * Do time increment
+ * The binary counter moves here and the BCD date in bytes 3~7 rolls
+ * with it at midnight, BCD time in bytes 0~2 is produced on demand
  */
 void _time_increment() {
-    // Do the main time increment logic here
-    _DATA_STORE[0]++;
-    if (_DATA_STORE[0] == 0x5A) {   // Check second
-        _DATA_STORE[0] = 0x00;
-        _DATA_STORE[1]++;   // Add 1 minute
-        _RTC_action_bits |= BIT3;   // Let's check alarms when second becomes 0
-    } else {
-        _time_carry(_DATA_STORE);
+    __disable_interrupt();      // The START latch must not see half a carry
+    _RTC_seconds++;
+    if (++_RTC_second == 60) {
+        _RTC_second = 0;
+        _RTC_action_bits |= BIT3;       // Let's check alarms when second becomes 0
+        if (++_RTC_minute == 1440) {
+            _RTC_minute = 0;
+            _RTC_day++;
+            _date_increment();
+        }
     }
+    __enable_interrupt();
+}
 
-    if (_DATA_STORE[1] == 0x5A) {   // Check minute, same logic with minute
-        _DATA_STORE[1] = 0x00;
-        _DATA_STORE[2]++;   // Add 1 hour
-    } else {
-        _time_carry(_DATA_STORE + 1);
+/**
+ * Bring the BCD time in bytes 0~2 in line with the binary counter
+ * Main loop only, the I2C reads use _time_byte()
+ */
+void _time_materialize() {
+    unsigned int minute;
+    unsigned char hour;
+
+    minute = _RTC_minute;
+    hour = 0;
+    while (minute >= 60) {
+        minute -= 60;
+        hour++;
     }
+    _DATA_STORE[0] = _to_BCD(_RTC_second);
+    _DATA_STORE[1] = _to_BCD(minute);
+    _DATA_STORE[2] = _to_BCD(hour);
+}
 
-    if (_DATA_STORE[2] == 0x24) {   // Check hour
-        _DATA_STORE[2] = 0x00;
-        _DATA_STORE[3]++;   // Add 1 day
-        _DATA_STORE[4]++;   // Add 1 date
-    } else {
-        _time_carry(_DATA_STORE + 2);
+/**
+ * Reload the binary counter from the BCD bytes 0~7
+ * Century 0x21 counts as 2100~2135, anything else as 2000~2099
+ * Call with interrupts disabled
+ */
+void _time_from_BCD() {
+    unsigned char year, month;
+    unsigned int day;
+
+    year = _from_BCD(_DATA_STORE[6]);
+    if (_DATA_STORE[7] == 0x21)
+        year += 100;
+    month = _from_BCD(_DATA_STORE[5]);
+    if (month < 1 || month > 12)
+        month = 1;
+
+    day = (unsigned int)year * 365 + ((year + 3) >> 2);    // Leap days of the years before, 2000 is leap
+    if (year > 100)
+        day--;                              // 2100 is not leap
+    day += _days_before_month[month - 1] + _from_BCD(_DATA_STORE[4]) - 1;
+    if (month > 2 && _is_leap_year())
+        day++;
+
+    _RTC_second = _from_BCD(_DATA_STORE[0]);
+    _RTC_minute = _from_BCD(_DATA_STORE[2]) * 60 + _from_BCD(_DATA_STORE[1]);
+    _RTC_day = day;
+    _RTC_seconds = (unsigned long)day * 86400 + (unsigned long)_RTC_minute * 60 + _RTC_second;
+}
+
+/**
+ * Reload the counter and the BCD date in bytes 3~7 from seconds since
+ * 2000-01-01
+ * The date is worked out once here, ticks after that roll it forward
+ * as usual. Call with interrupts disabled
+ */
+void _time_from_seconds(unsigned long seconds) {
+    unsigned int day, rest, before, leap;
+    unsigned char year, month;
+
+    day = seconds / 86400;
+    rest = (seconds - (unsigned long)day * 86400) / 2;  // Fits 16 bits
+    _RTC_minute = rest / 30;
+    _RTC_second = (rest - _RTC_minute * 30) * 2 + (seconds & 1);
+    _RTC_day = day;
+    _RTC_seconds = seconds;
+
+    _DATA_STORE[3] = (day + 5) % 7 + 1;     // 2000-01-01 is a Saturday
+    for (year = 0; ; year++) {
+        leap = !(year & 3) && year != 100;
+        if (day < 365 + leap)
+            break;
+        day -= 365 + leap;
+    }
+    for (month = 12; ; month--) {
+        before = _days_before_month[month - 1];
+        if (month > 2)
+            before += leap;
+        if (day >= before)
+            break;
+    }
+    _DATA_STORE[4] = _to_BCD(day - before + 1);
+    _DATA_STORE[5] = _to_BCD(month);
+    _DATA_STORE[6] = _to_BCD(year >= 100 ? year - 100 : year);
+    _DATA_STORE[7] = year >= 100 ? 0x21 : 0x20;
+}
+
+/**
+ * Commit the staged time bytes in one go
+ * Bytes not written by host keep the current time, Unix times before
+ * 2000 start the clock at 2000-01-01. The counter is
+ * reloaded and a new second starts right now.
+ * Called from the main loop only. The commit works out the date and
+ * moves the schedule, far too long for USI_INT, so a START that comes
+ * before it is held with SCL low, see _USI_I2C_slave_held(). Reads
+ * therefore always see the committed time.
+ */
+void _time_commit() {
+    unsigned int sr;
+    unsigned long seconds;
+#ifdef _TIMERS
+    unsigned long old;
+#endif
+    unsigned short now;
+    unsigned char i;
+
+    sr = __get_SR_register();
+    __disable_interrupt();
+#ifdef _TIMERS
+    old = _RTC_seconds;
+#endif
+    if (_TIME_stage_mask & _TIME_UNIX) {
+        seconds = _RTC_seconds + _UNIX_2000;
+        for (i = 0; i < 4; i++) {
+            if (!(_TIME_stage_mask & (0x100 << i)))
+                _TIME_buff[i] = seconds;
+            seconds >>= 8;
+        }
+        seconds = ((unsigned long)_TIME_buff[3] << 24) | ((unsigned long)_TIME_buff[2] << 16) |
+                ((unsigned int)_TIME_buff[1] << 8) | _TIME_buff[0];
+        _time_from_seconds(seconds < _UNIX_2000 ? 0 : seconds - _UNIX_2000);
+    } else if (_TIME_stage_mask) {
+        _time_materialize();
+        for (i = 0; i < 8; i++)
+            if (_TIME_stage_mask & (1 << i))
+                _DATA_STORE[i] = _TIME_buff[i];
+        _time_from_BCD();
+    }
+    if (_TIME_stage_mask) {
+        _TIME_stage_mask = 0;
+        _USI_I2C_slave_hold = 0;
+#ifdef _TIMERS
+        seconds = _RTC_seconds - old;       // Timers count elapsed time, move them along
+        for (i = 0; i < _TIMERS; i++)
+            _TIMER_due[i] += seconds;
+        _timer_schedule();                  // Keeps the no timer mark
+#endif
+#ifdef _EVENT_LOG
+        _log_event(_LOG_TIME_SET);
+#endif
+
+        now = TAR;                  // Reset the sub-second phase
+        _RTC_tick = now;
+        _sched_at(_EV_SECOND, now + _second_div);
+        if ((_DATA_STORE[28] & _SQW_MASK) == _SQW_1HZ)
+            _sched_at(_EV_HALF, now + _half_second);
+        _sched_arm();
+        if ((_DATA_STORE[28] & _SQW_MASK) == _SQW_1HZ)
+            P1OUT |= BIT0;          // 1-Hz output rising edge for the new second
+        _RTC_action_bits &= ~BIT0;  // Drop an increment still due from the old phase
+        _RTC_action_bits2 |= BIT5;  // Rebuild the alarm index
+        _USI_I2C_slave_wake = 1;
+    }
+    __bis_SR_register(sr & GIE);
+}
+
+/**
+ * Stage a time byte written by host, committed at STOP
+ * Both views share _TIME_buff, the RX callback refuses bytes for the
+ * other view while one has bytes staged.
+ */
+void _time_stage(unsigned char epoch, unsigned char i, unsigned char value) {
+    if (!_TIME_stage_mask) {                // Watch for the STOP of this transaction
+        _sched_at(_EV_I2C_STOP, TAR + _stop_poll_ticks);
+        _sched_arm();
+        _USI_I2C_slave_hold = 1;
+    }
+    _TIME_buff[i] = value;
+    _TIME_stage_mask |= (epoch ? 0x100 : 1) << i;
+}
+
+/**
+ * Time byte for the TX callback, worked out from the copy taken at START
+ *      Bytes 0~7:  BCD time as in the data store
+ *      Unix time:  Seconds since 1970-01-01, 4 bytes, LSB first, at
+ *                  0x74~0x77. Read and write as one 4 byte transfer.
+ * Runs in USI_INT, so bounded arithmetic only. The fraction at 0x7E,
+ * 0x7F follows the last time byte read.
+ */
+unsigned char * _time_byte(unsigned char offset) {
+    unsigned long seconds;
+    unsigned int minute;
+    unsigned char hour;
+    signed char elapsed;
+
+    _TIME_sub[0] = _TIME_frac >> 8;
+    _TIME_sub[1] = _TIME_frac;
+    if (offset >= _UNIX_BASE) {
+        elapsed = _RTC_second - _TIME_buff[0];  // Seconds counted since START
+        if (elapsed < 0)
+            elapsed += 60;
+        seconds = _RTC_seconds - elapsed + _UNIX_2000;
+        for (offset -= _UNIX_BASE; offset; offset--)
+            seconds >>= 8;
+        _TIME_out = seconds;
+        return &_TIME_out;
+    }
+    if (offset >= 3)                        // The date, kept current by _time_increment()
+        return _TIME_buff + offset;
+    if (offset == 0) {
+        _TIME_out = _to_BCD(_TIME_buff[0]);
+        return &_TIME_out;
     }
+    minute = ((unsigned int)_TIME_buff[2] << 8) | _TIME_buff[1];
+    hour = 0;
+    while (minute >= 60) {                  // 23 steps at most
+        minute -= 60;
+        hour++;
+    }
+    _TIME_out = _to_BCD(offset == 1 ? minute : hour);
+    return &_TIME_out;
+}
+
+/**
+ * Move the BCD date in bytes 3~7 one day forward
+ */
+void _date_increment() {
+    _DATA_STORE[3]++;   // Add 1 day
+    _DATA_STORE[4]++;   // Add 1 date
 
     if (_DATA_STORE[3] == 0x08)     // Check day
         _DATA_STORE[3] = 0x01;
 
     switch (_DATA_STORE[4]) {       // Check date
     case 0x29:
-        if (_DATA_STORE[5] == 0x02 && !_is_leap_year) {   // It's February
+        if (_DATA_STORE[5] == 0x02 && !_is_leap_year()) {   // It's February
             _DATA_STORE[4] = 0x01;
             _DATA_STORE[5]++;
         }
@@ -319,7 +978,6 @@ void _time_increment() {
     if (_DATA_STORE[5] == 0x13) {   // Check month
         _DATA_STORE[5] = 0x01;
         _DATA_STORE[6]++;   // Add 1 year
-        _RTC_action_bits |= BIT2;   // Let's check the leap year later
     } else {
         _time_carry(_DATA_STORE + 5);
     }
@@ -330,13 +988,6 @@ void _time_increment() {
     } else {
         _time_carry(_DATA_STORE + 6);
     }
-    // After changes with the year
-    if (_RTC_action_bits & BIT2) {
-        // let's check the leap year property
-        _check_leap_year();
-        _RTC_action_bits &= ~BIT2;
-    }
-
     if (_DATA_STORE[7] == 0x9A) {   // Check century
         _DATA_STORE[7] = 0x00;  // Century start over
     } else {
@@ -344,139 +995,172 @@ void _time_increment() {
     }
 }
 
+/**
+ * Binary to BCD for 0~99
+ */
+unsigned char _to_BCD(unsigned char value) {
+    unsigned char tens = 0;
+    while (value >= 10) {
+        value -= 10;
+        tens += 0x10;
+    }
+    return tens + value;
+}
+
+/**
+ * BCD to binary
+ */
+unsigned char _from_BCD(unsigned char bcd) {
+    return (bcd >> 4) * 10 + (bcd & 0x0F);
+}
+
 /**
  * Deal with carry
  */
 void _time_carry(unsigned char * byte) {
-    _RTC_byte_l = *byte << 4;
-    if (_RTC_byte_l == 0xA0) {
-        _RTC_byte_h = *byte >> 4;
-        _RTC_byte_h++;
-        *byte = _RTC_byte_h << 4;
+    unsigned char byte_l, byte_h;
+    byte_l = *byte << 4;
+    if (byte_l == 0xA0) {
+        byte_h = *byte >> 4;
+        byte_h++;
+        *byte = byte_h << 4;
+    }
+}
+
+/**
+ * Registers of alarm n, 0: Alarm1
+ */
+unsigned char * _alarm_reg(unsigned char n) {
+    if (n < 6)
+        return _DATA_STORE + 8 + n * 3;
+    return _DATA_STORE + _DS_ALARM_EXT + (n - 6) * 3;
+}
+
+/**
+ * Rebuild the alarm index
+ * Finds the first minute strictly after the current one at which any
+ * alarm matches, and the set of alarms matching then.
+ * Called when alarm or time registers are written and after a firing.
+ */
+void _alarm_schedule() {
+    unsigned char n, d, dow, mask, hour, minute;
+    unsigned char * reg;
+    unsigned int now, at, delta, best = 0xFFFF;
+    unsigned long bit = 1, fire = 0;
+
+    now = _RTC_minute;
+    dow = _DATA_STORE[3] - 1;       // 0~6: Mon~Sun, kept current by _time_increment()
+
+    for (n = 0; n < _ALARM_COUNT; n++, bit <<= 1) {
+        reg = _alarm_reg(n);
+        if (!(reg[1] & 0x80))       // Match not enabled
+            continue;
+        hour = reg[1] & 0x7F;
+        minute = reg[0];
+        if (hour > 0x23 || minute > 0x59 ||
+                _to_BCD(_from_BCD(hour)) != hour ||
+                _to_BCD(_from_BCD(minute)) != minute)
+            continue;               // Never matches a valid time
+        if (reg[2] & 0x80)          // Every day
+            mask = 0x7F;
+        else if (dow < 7)
+            mask = reg[2];
+        else
+            continue;               // Day register invalid, day masks never match
+        at = _from_BCD(hour) * 60 + _from_BCD(minute);
+        for (d = (at > now) ? 0 : 1; d < 8; d++)
+            if (mask & (1 << ((dow + d) % 7)))
+                break;
+        if (d == 8)
+            continue;               // Empty day mask
+        delta = d * 1440 + at - now;
+        if (delta < best) {
+            best = delta;
+            fire = bit;
+        } else if (delta == best) {
+            fire |= bit;
+        }
+    }
+
+    _ALARM_next_mask = fire;
+    if (!fire) {
+        _ALARM_next_day = 0xFFFF;
+        return;
+    }
+    at = now + best;
+    _ALARM_next_day = _RTC_day;
+    while (at >= 1440) {
+        at -= 1440;
+        _ALARM_next_day++;
     }
+    _ALARM_next_minute = at;
 }
 
 /**
  * Alarm logic here
+ * Runs at every new minute, only the precomputed next firing is compared
  */
 void _check_alarms() {
-    unsigned char day_mask_bit = 0x00;
+    unsigned char n;
+    unsigned long bit = 1;
 
-    switch (_DATA_STORE[3]) {
-    case 0x01:
-        day_mask_bit = MON;
-        break;
-    case 0x02:
-        day_mask_bit = TUE;
-        break;
-    case 0x03:
-        day_mask_bit = WED;
-        break;
-    case 0x04:
-        day_mask_bit = THU;
-        break;
-    case 0x05:
-        day_mask_bit = FRI;
-        break;
-    case 0x06:
-        day_mask_bit = SAT;
-        break;
-    case 0x07:
-        day_mask_bit = SUN;
-        break;
-    }
+    if (_RTC_minute != _ALARM_next_minute ||
+            _RTC_day != _ALARM_next_day)
+        return;
 
-    // Alarm 1
-    if (_DATA_STORE[1] == _DATA_STORE[8] &&
-            _DATA_STORE[2] + 0x80 == _DATA_STORE[9] &&
-            (_DATA_STORE[10] & 0x80 ||
-                    _DATA_STORE[10] & day_mask_bit))
-        _DATA_STORE[30] |= BIT0;
-    // Alarm 2
-    if (_DATA_STORE[1] == _DATA_STORE[11] &&
-            _DATA_STORE[2] + 0x80 == _DATA_STORE[12] &&
-            (_DATA_STORE[13] & 0x80 ||
-                    _DATA_STORE[13] & day_mask_bit))
-        _DATA_STORE[30] |= BIT1;
-    // Alarm 3
-    if (_DATA_STORE[1] == _DATA_STORE[14] &&
-            _DATA_STORE[2] + 0x80 == _DATA_STORE[15] &&
-            (_DATA_STORE[16] & 0x80 ||
-                    _DATA_STORE[16] & day_mask_bit))
-        _DATA_STORE[30] |= BIT2;
-    // Alarm 4
-    if (_DATA_STORE[1] == _DATA_STORE[17] &&
-            _DATA_STORE[2] + 0x80 == _DATA_STORE[18] &&
-            (_DATA_STORE[19] & 0x80 ||
-                    _DATA_STORE[19] & day_mask_bit))
-        _DATA_STORE[30] |= BIT3;
-    // Alarm 5
-    if (_DATA_STORE[1] == _DATA_STORE[20] &&
-            _DATA_STORE[2] + 0x80 == _DATA_STORE[21] &&
-            (_DATA_STORE[22] & 0x80 ||
-                    _DATA_STORE[22] & day_mask_bit))
-        _DATA_STORE[30] |= BIT4;
-    // Alarm 6
-    if (_DATA_STORE[1] == _DATA_STORE[23] &&
-            _DATA_STORE[2] + 0x80 == _DATA_STORE[24] &&
-            (_DATA_STORE[25] & 0x80 ||
-                    _DATA_STORE[25] & day_mask_bit))
-        _DATA_STORE[30] |= BIT5;
+    for (n = 0; n < _ALARM_COUNT; n++, bit <<= 1) {
+        if (!(_ALARM_next_mask & bit))
+            continue;
+        if (n < 8)
+            _DATA_STORE[30] |= 1 << n;
+        else
+            _DATA_STORE[34 + ((n - 8) >> 3)] |= 1 << (n & 7);
+#ifdef _EVENT_LOG
+        _log_event(_LOG_ALARM + n);
+#endif
+    }
+    _alarm_schedule();
 }
 
 /**
  * Check alarm interrupt flag and output interrupt
+ * Returns 1 if any output was raised
  */
-void _alarm_interrupt() {
-    unsigned char INT_uni = 0;
-    unsigned char INT_A1 = 0, INT_A2 = 0, INT_A3 = 0;
-
-    // Alarm 1
-    if (_DATA_STORE[30] & BIT0 &&
-            _DATA_STORE[29] & BIT0) {
-        INT_uni = 1;
-        if (_DATA_STORE[28] & 0x80)
-            INT_A1 = 1;
-    }
-    // Alarm 2
-    if (_DATA_STORE[30] & BIT1 &&
-            _DATA_STORE[29] & BIT1) {
-        INT_uni = 1;
-        if (_DATA_STORE[28] & 0x80)
-            INT_A2 = 1;
-    }
-    // Alarm 3
-    if (_DATA_STORE[30] & BIT2 &&
-            _DATA_STORE[29] & BIT2) {
-        INT_uni = 1;
-        if (_DATA_STORE[28] & 0x80)
-            INT_A3 = 1;
-    }
-    // Alarm 4
-    if (_DATA_STORE[30] & BIT3 &&
-            _DATA_STORE[29] & BIT3 &&
-            !INT_uni)
-        INT_uni = 1;
-    // Alarm 5
-    if (_DATA_STORE[30] & BIT4 &&
-            _DATA_STORE[29] & BIT4 &&
-            !INT_uni)
-        INT_uni = 1;
-    // Alarm 6
-    if (_DATA_STORE[30] & BIT5 &&
-            _DATA_STORE[29] & BIT5 &&
-            !INT_uni)
-        INT_uni = 1;
+unsigned char _alarm_interrupt() {
+    unsigned char INT_uni, i;
+#ifdef _TIMERS
+    unsigned char pulse = 0;
+#endif
+
+    // Unison output for any enabled alarm with its flag set
+    INT_uni = _DATA_STORE[29] & _DATA_STORE[30];
+    for (i = 31; i < 34; i++)
+        INT_uni |= _DATA_STORE[i] & _DATA_STORE[i + 3];
+
+#ifdef _TIMERS
+    for (i = 0; i < _TIMERS; i++) {         // Fired timers routed to the outputs
+        if (!(_TIMER_reg[i * 3 + 2] & _TIMER_FIRED))
+            continue;
+        if (_TIMER_reg[i * 3 + 2] & _TIMER_P1_5)
+            INT_uni |= 1;
+        if (_TIMER_reg[i * 3 + 2] & _TIMER_P1_4) {
+            P1OUT |= BIT4;                  // Shared with the temperature ready pulse
+            pulse = 1;
+        }
+    }
+#endif
 
     // Set the interrupt output pin to high
     if (INT_uni)
         P1OUT |= BIT5;
-    if (INT_A1)
-        P2OUT |= BIT0;
-    if (INT_A2)
-        P2OUT |= BIT1;
-    if (INT_A3)
-        P2OUT |= BIT2;
+    if (_DATA_STORE[28] & 0x80)     // Dedicated outputs for Alarm1~3
+        P2OUT |= _DATA_STORE[29] & _DATA_STORE[30] & (BIT0 + BIT1 + BIT2);
+
+#ifdef _TIMERS
+    return INT_uni != 0 || pulse;
+#else
+    return INT_uni != 0;
+#endif
 }
 
 /**
@@ -487,96 +1171,1297 @@ void _alarm_reset_interrupt() {
     P2OUT &= ~(BIT0 + BIT1 + BIT2);
 }
 
-/***********************************************
- * Mandatory functions for callback
- * You can modify codes in these functions
- *         to deal with data received
- *         or data to be sent
- *         but left function name unchanged
- ***********************************************/
-unsigned char * USI_I2C_slave_TX_callback() {
-    unsigned char _I2C_data_offset_1;
-    _I2C_data_offset_1 = _I2C_data_offset;
-    if (_I2C_data_offset_1 == 26)           // User reading the high part of the temperature result
-        _TEMP_data_user_read = 1;
-    if (_I2C_data_offset_1 == 27 &&
-            _TEMP_data_user_read) {         // User reading the low part of the temperature result
-        _DATA_STORE[28] &= ~BIT5;           // Clear temperature data ready bit
-        _TEMP_data_user_read = 0;
+/**
+ * Apply the P1.0 square wave selected by bits 1~0 of register 28
+ *      0:  1 Hz, high for the first half of each second. The default
+ *      1:  32768 Hz, ACLK routed to the pin, no CPU involved
+ *      2~3: Off, low
+ * Only ACLK itself can reach P1.0 without the CPU: the pin has no Timer_A
+ * output, and Timer_A runs the scheduler in continuous mode, so the
+ * 1024~8192 Hz rates of the DS3231 would cost an interrupt per edge.
+ * The 1 Hz edges stay on the second events, with the half second event
+ * only scheduled while 1 Hz is selected, so the other settings save one
+ * Timer_A0 interrupt each second.
+ */
+void _sqw_mode() {
+    unsigned short sr;
+    unsigned char mode = _DATA_STORE[28] & _SQW_MASK;
+
+    sr = __get_SR_register();
+    __disable_interrupt();
+    P1OUT &= ~BIT0;                 // Low until the next second starts
+    if (mode == _SQW_ACLK)
+        P1SEL |= BIT0;              // P1.0 as ACLK output
+    else
+        P1SEL &= ~BIT0;
+    if (mode == _SQW_1HZ) {
+        _sched_at(_EV_HALF, _sched_time[_EV_SECOND] + _half_second);
+        _sched_arm();
     }
-    _I2C_data_offset++;
-    return _DATA_STORE + _I2C_data_offset_1;
+    __bis_SR_register(sr & GIE);
 }
 
-unsigned char USI_I2C_slave_RX_callback(unsigned char * byte) {
-    unsigned char byte_data;
-    byte_data = *byte;
-    if (!_USI_I2C_slave_n_byte) {
-        _I2C_data_offset = byte_data;
-        _USI_I2C_slave_n_byte = 1;
-    } else {
-        if (_I2C_data_offset != 26 &&
-                _I2C_data_offset != 27) {
-            switch(_I2C_data_offset) {
-            case 28:    // Do not allow 1 on BIT5 when BIT5 in _DATA_STORE[28] is 0
-                if (!(_DATA_STORE[28] & BIT5) &&
-                        (byte_data & BIT5))
-                    _DATA_STORE[28] = byte_data & ~BIT5;
-                break;
-            case 30:    // Do not allow 1 for alarm interrupt flags when flags are 0
-                if (!(_DATA_STORE[30] & BIT0) &&
-                        (byte_data & BIT0))
-                    byte_data &= ~BIT0;
-                if (!(_DATA_STORE[30] & BIT1) &&
-                        (byte_data & BIT1))
-                    byte_data &= ~BIT1;
-                if (!(_DATA_STORE[30] & BIT2) &&
-                        (byte_data & BIT2))
-                    byte_data &= ~BIT2;
-                if (!(_DATA_STORE[30] & BIT3) &&
-                        (byte_data & BIT3))
-                    byte_data &= ~BIT3;
-                if (!(_DATA_STORE[30] & BIT4) &&
-                        (byte_data & BIT4))
-                    byte_data &= ~BIT4;
-                if (!(_DATA_STORE[30] & BIT5) &&
-                        (byte_data & BIT5))
-                    byte_data &= ~BIT5;
-                _DATA_STORE[30] = byte_data;
-                break;
-            default:
-                *(_DATA_STORE + _I2C_data_offset) = byte_data;
-            }
-        }
-        _I2C_data_offset++;
+/**
+ * Run MCLK at the strap ceiling, or at the 1MHz floor
+ * Called from the USI ISR on START and from the main loop with interrupts
+ * disabled. The USI and the main loop wake at 1MHz and raise the clock
+ * for an I2C transaction or heavy work, the main loop drops it again
+ * before sleeping once the bus saw STOP.
+ * DCOCTL is cleared first so that the DCO does not overshoot while
+ * BCSCTL1 changes, and FCTL2 follows so the flash timing generator stays
+ * within 257~476kHz. The DCO settles within a few us, the switch takes
+ * 30 cycles at 1MHz with the call. Run "rtc_sim clock" for the cost.
+ */
+void _clock_set(unsigned char fast) {
+    if (!(_CLK_state & _CLK_CEILING) || !fast == !(_CLK_state & _CLK_FAST))
+        return;
+    _CLK_state ^= _CLK_FAST;
+    DCOCTL = 0;
+    switch (fast ? _CLK_state & _CLK_CEILING : 0) {
+    case 1:
+        BCSCTL1 = CALBC1_8MHZ;
+        DCOCTL = CALDCO_8MHZ;
+        FCTL2 = FWKEY + FSSEL_1 + FN4 + FN2 + FN1 + FN0;    // MCLK / 24
+        break;
+    case 2:
+        BCSCTL1 = CALBC1_12MHZ;
+        DCOCTL = CALDCO_12MHZ;
+        FCTL2 = FWKEY + FSSEL_1 + FN5 + FN1 + FN0;          // MCLK / 36
+        break;
+    case 3:
+        BCSCTL1 = CALBC1_16MHZ;
+        DCOCTL = CALDCO_16MHZ;
+        FCTL2 = FWKEY + FSSEL_1 + FN5 + FN3 + FN2 + FN1 + FN0;  // MCLK / 48
+        break;
+    default:
+        BCSCTL1 = CALBC1_1MHZ;
+        DCOCTL = CALDCO_1MHZ;
+        FCTL2 = FWKEY + FSSEL_1 + FN1;                      // MCLK / 3
+        break;
     }
-    return 0;   // 0: No error; Not 0: Error in received data
 }
 
-void _USI_I2C_slave_reset_byte_count() {
-    _USI_I2C_slave_n_byte = 0;
+/**
+ * Sleep in LPM3 and account the residency counters (simulator and _DIAG)
+ * Must be called with interrupts disabled. Returns with interrupts enabled.
+ */
+void _LPM3_sleep() {
+#if defined(_HAL_HOST) || defined(_DIAG)
+    _RES_active += (unsigned short)(TAR - _RES_mark);
+    _RES_mark = TAR;
+#endif
+    __bis_SR_register(LPM3_bits + GIE);
+#if defined(_HAL_HOST) || defined(_DIAG)
+    _RES_LPM3 += (unsigned short)(TAR - _RES_mark);
+    _RES_mark = TAR;
+#endif
 }
-//**********************************************/
 
-#ifdef _UART_OUTPUT
 /**
- * Extra functions for software UART
+ * Start the next temperature conversion waiting, if the ADC10 is free
+ * A host request goes before a periodic sample.
  */
-void _UART_TX_byte(unsigned char byte) {
-    // Code bases on TI's example
-    _UART_n_bit = 0xA;                  // Load Bit counter, 8data + ST/SP
-    while (TACCR1 != TAR)               // Prevent async capture
-        TACCR1 = TAR;                   // Current state of TA counter
-    TACCR1 += _UART_period_1200;        // Some time till first bit
-    _UART_TX_data = byte | 0x100;       // Add mark stop bit to _UART_TX_data
-    _UART_TX_data = _UART_TX_data << 1; // Add space start bit
-    TACCTL1 = (OUTMOD0 + CCIE);         // TXD = mark = idle
-    while (TACCTL1 & CCIE);             // Wait for TX completion
+void _temp_next() {
+    if (_TEMP_state & (_TEMP_HOST + _TEMP_SAMPLE))
+        return;
+    if (_DATA_STORE[28] & BIT6) {
+        _DATA_STORE[28] &= ~BIT6;           // Clear the start bit
+        _TEMP_state |= _TEMP_HOST;
+        _temp_start(_DATA_STORE[28] & BIT3);
+    } else if (_TEMP_state & _TEMP_DUE_ANY) {
+        _TEMP_state |= _TEMP_SAMPLE;        // Periodic samples are always averaged
+        _temp_start(1);
+    }
 }
 
-void _UART_send_datetime() {
-    unsigned int idx = 8;
+/**
+ * Start a temperature conversion
+ * Averaged: the DTC stores _TEMP_SAMPLES conversions in _TEMP_block
+ * and the ADC10 interrupts once, when the block is complete.
+ */
+void _temp_start(unsigned char averaged) {
+    ADC10CTL0 &= ~ENC;                      // Control bits only change with ENC clear
+    if (averaged) {
+        ADC10CTL1 = INCH_10 + ADC10DIV_3 + CONSEQ_2;    // Repeat single channel
+        ADC10CTL0 |= MSC;
+        ADC10DTC0 = 0;                      // One block, then stop
+        ADC10DTC1 = _TEMP_SAMPLES;
+        ADC10SA = _HAL_ADDR(_TEMP_block);   // Arms the DTC
+    } else {
+        ADC10CTL1 = INCH_10 + ADC10DIV_3;
+        ADC10CTL0 &= ~MSC;
+        ADC10DTC1 = 0;                      // DTC off, result in ADC10MEM
+    }
+    ADC10CTL0 |= ENC + ADC10SC;
+}
+
+/**
+ * Result of the finished temperature conversion
+ * Averaged: the sum of the block is scaled to 10.6 fixed point, so
+ * the 10-bit code sits in the upper bits as with ADC10DF, and the TLV
+ * gain, offset and 1.5V reference calibration is applied.
+ * Each sample, host or periodic, also goes to Celsius once here, so
+ * hosts read 0xEC, 0xED (signed 8.8 fixed point, MSB first) instead of
+ * working the sensor formula out themselves.
+ */
+unsigned int _temp_result() {
+    unsigned int sum = 0, code;
+    unsigned char i;
+    if (!ADC10DTC1) {                       // Single conversion
+        code = ADC10MEM;
+        _TEMP_celsius = _temp_celsius(_temp_calibrate(code << 6));
+        return code;
+    }
+    for (i = 0; i < _TEMP_SAMPLES; i++)
+        sum += _TEMP_block[i];
+    code = _temp_calibrate(sum * (64 / _TEMP_SAMPLES));
+    _TEMP_celsius = _temp_celsius(code);
+    return code;
+}
+
+/**
+ * Apply the ADC10 TLV calibration to a code in 10.6 fixed point
+ * Parts without ADC10 calibration data get the code unchanged.
+ */
+unsigned int _temp_calibrate(unsigned int code) {
+    long value;
+    if (TLV_ADC10_1_TAG != TAG_ADC10_1)
+        return code;
+    value = ((unsigned long)code * _HAL_TLV_ADC10[CAL_ADC_15VREF_FACTOR]) >> 15;
+    value = ((unsigned long)value * _HAL_TLV_ADC10[CAL_ADC_GAIN_FACTOR]) >> 15;
+    value += (long)(short)_HAL_TLV_ADC10[CAL_ADC_OFFSET] << 6;
+    if (value < 0)
+        return 0;
+    if (value > 0xFFFF)
+        return 0xFFFF;
+    return value;
+}
+
+/**
+ * Temperature in Celsius, 8.8 fixed point, from a code in 10.6 fixed point
+ * The TLV codes at 30C and 85C go through the same calibration as the
+ * code. Parts without ADC10 calibration data, or with erased or corrupt
+ * codes that do not rise from 30C to 85C, use the typical sensor from
+ * the datasheet, 3.55mV/C and 986mV at 0C.
+ * Saturates at +-127.99C, codes far out of range or a narrow calibration
+ * span would not fit 16 bits. -128C stays free for _TEMP_NONE.
+ */
+int _temp_celsius(unsigned int code) {
+    unsigned int t30 = 0, t85 = 0;
+    long t;
+    if (TLV_ADC10_1_TAG == TAG_ADC10_1) {
+        t30 = _temp_calibrate(_HAL_TLV_ADC10[CAL_ADC_15T30] << 6);
+        t85 = _temp_calibrate(_HAL_TLV_ADC10[CAL_ADC_15T85] << 6);
+    }
+    if (t85 <= t30) {
+        t30 = 47686;                        // 1.0925V / 1.5V * 1023 * 64
+        t85 = 56204;                        // 1.28775V / 1.5V * 1023 * 64
+    }
+    t = 30 * 256 + ((long)code - t30) * (55 * 256) / (long)(t85 - t30);
+    if (t > 32767)
+        return 32767;
+    if (t < -32767)
+        return -32767;
+    return t;
+}
+
+#if defined(_TEMP_HISTORY) || defined(_TEMP_COMP) || defined(_TEMP_ALARM)
+/**
+ * Count down the sample intervals, called once a minute
+ */
+void _temp_periodic() {
+#ifdef _TEMP_HISTORY
+    if (_HIST_interval && !--_HIST_countdown) {
+        _HIST_countdown = _HIST_interval;
+        _TEMP_state |= _TEMP_DUE;
+    }
+#endif
+#ifdef _TEMP_COMP
+    if (!--_TCOMP_countdown) {
+        _TCOMP_countdown = _TEMP_COMP;
+        _TEMP_state |= _TEMP_COMP_DUE;
+    }
+#endif
+#ifdef _TEMP_ALARM
+    if (_DATA_STORE[33] & (_TEMP_HIGH + _TEMP_LOW))     // Thresholds watched
+        _TEMP_state |= _TEMP_ALARM_DUE;
+#endif
+    _temp_next();
+}
+#endif
+
+#ifdef _TEMP_ALARM
+/**
+ * Check the last sample against the temperature thresholds
+ * Runs after each sample, from the host or periodic, and once a minute
+ * while either threshold is enabled. Crossing a threshold sets its flag,
+ * Alarm31 for high and Alarm32 for low in byte 36, which pulses P1.5 as
+ * other alarms do when enabled in byte 33. It sets the flag again only
+ * once the temperature came back by the hysteresis.
+ *      0xEE:   High threshold in Celsius, signed, flags at and above, 127 by default
+ *      0xEF:   Low threshold in Celsius, signed, flags below, -128 by default
+ *      0xF0:   Hysteresis in Celsius, 2 by default
+ * Writing a threshold rearms it.
+ */
+void _temp_alarm() {
+    int t = _TEMP_celsius >> 8;             // Whole degrees, rounded down
+    int high = (signed char)_TALARM_reg[0];
+    int low = (signed char)_TALARM_reg[1];
+
+    if (t >= high) {
+        if (!(_TEMP_state & _TEMP_HIGH)) {
+            _TEMP_state |= _TEMP_HIGH;
+            _DATA_STORE[36] |= _TEMP_HIGH;
+#ifdef _EVENT_LOG
+            _log_event(_LOG_TEMP_HIGH);
+#endif
+        }
+    } else if (t < high - _TALARM_reg[2]) {
+        _TEMP_state &= ~_TEMP_HIGH;
+    }
+    if (t < low) {
+        if (!(_TEMP_state & _TEMP_LOW)) {
+            _TEMP_state |= _TEMP_LOW;
+            _DATA_STORE[36] |= _TEMP_LOW;
+#ifdef _EVENT_LOG
+            _log_event(_LOG_TEMP_LOW);
+#endif
+        }
+    } else if (t >= low + _TALARM_reg[2]) {
+        _TEMP_state &= ~_TEMP_LOW;
+    }
+}
+#endif
+
+#ifdef _TEMP_HISTORY
+
+/**
+ * Append a sample to the history, the oldest entry goes when full
+ * The stamp is minutes since 2000-01-01, modulo 65536 (45 days).
+ */
+void _temp_history_add(unsigned int value) {
+    unsigned short stamp;
+    unsigned char * entry;
+    unsigned char i;
+
+    stamp = (unsigned short)(_RTC_day * 1440 + _RTC_minute);
+    __disable_interrupt();                  // The I2C callbacks drop entries
+    if (_HIST_count == _TEMP_HISTORY) {
+        if (++_HIST_tail == _TEMP_HISTORY)
+            _HIST_tail = 0;
+        _HIST_count--;
+    }
+    i = _HIST_tail + _HIST_count;
+    if (i >= _TEMP_HISTORY)
+        i -= _TEMP_HISTORY;
+    entry = _HIST_ring + i * 4;
+    entry[0] = stamp >> 8;
+    entry[1] = stamp;
+    entry[2] = value >> 8;
+    entry[3] = value;
+    _HIST_count++;
+    __enable_interrupt();
+}
+
+/**
+ * Byte of the history window for the TX callback
+ *      0x80:       Sample interval in minutes, 0: off. Read/write
+ *      0x81:       Number of entries held
+ *      0x82~:      Entries, oldest first, 4 bytes each:
+ *                  minute stamp MSB, LSB, averaged reading MSB, LSB
+ * Entries read to their last byte are dropped at the next START, so a
+ * host drains the history by reading 0x81 and the entries in one burst.
+ */
+unsigned char * _temp_history_byte(unsigned char offset) {
+    unsigned char i;
+    if (offset == 0)
+        return &_HIST_interval;
+    if (offset == 1)
+        return &_HIST_count;
+    offset -= 2;
+    i = offset >> 2;
+    if (i >= _HIST_count)
+        return (unsigned char *)&_I2C_pad;
+    i += _HIST_tail;
+    if (i >= _TEMP_HISTORY)
+        i -= _TEMP_HISTORY;
+    return _HIST_ring + i * 4 + (offset & 3);
+}
+#endif
+
+#ifdef _TRIM
+/**
+ * Take a new aging offset into the second length
+ * Each second lasts 32768 ACLK counts plus _TRIM_rate / 256. The
+ * fraction is carried from second to second in the Timer_A0 interrupt,
+ * so a second is one count longer or shorter now and then and the
+ * average is right. No wakeup is added.
+ * One step of the aging offset is 1/256 count per second, ~0.12ppm.
+ * Positive values slow the clock down as on the DS3231, the range is
+ * about +-15ppm.
+ */
+void _trim_update() {
+#ifdef _TEMP_COMP
+    _TRIM_rate = _TRIM_aging + _TRIM_temp;  // Single word write, the interrupt sees old or new
+#else
+    _TRIM_rate = _TRIM_aging;   // Single word write, the interrupt sees old or new
+#endif
+}
+#endif
+
+#ifdef _TEMP_COMP
+/**
+ * Follow the crystal over temperature, called with each compensation sample
+ * A tuning fork crystal slows down on both sides of its turnover
+ * temperature T0: df/f = -k * (T - T0)^2. The clock is sped up by as
+ * much, in aging offset steps of 2^-23 (0.119ppm):
+ *      steps = k[0.001ppm] * (T - T0)^2 * 2^23 / 10^9
+ * With T - T0 in 8.8 fixed point, |dT| fits 16 bits unsigned, dT^2 / 256
+ * is in 24.8 and times k still fits 32 bits. 10^9 / 2^23 * 2^8 = 30518.
+ *      0x7C:   Turnover temperature T0 in Celsius, signed, 25 by default
+ *      0x7D:   Curvature k in 0.001ppm per Celsius squared, 34 by default
+ *              0 turns the compensation off
+ * Writing either takes a new sample right away.
+ */
+void _tcomp_update(int celsius) {
+    long dt;
+    unsigned int dt_abs;
+    unsigned long steps;
+
+    dt = (long)celsius - (long)_TCOMP_turnover * 256;
+    dt_abs = dt < 0 ? -dt : dt;
+    steps = (unsigned long)dt_abs * dt_abs / 256 * _TCOMP_curve;
+    steps = (steps + 15259) / 30518;
+    if (steps > 30000)                      // Leave room for the aging offset
+        steps = 30000;
+    _TRIM_temp = -(int)steps;
+    _trim_update();
+}
+#endif
+
+#ifdef _PERSIST
+/**
+ * Registers kept in flash, by index
+ *      0~17:   Alarm1~6, bytes 8~25
+ *      18:     Configuration, bits _PERSIST_CFG of byte 28
+ *      19:     Alarm enables, byte 29
+ *      20~22:  Alarm enables, bytes 31~33
+ *      23~:    Alarm7 and up, then the aging offset, the compensation
+ *              curve, the history interval and the temperature thresholds
+ */
+unsigned char * _persist_reg(unsigned char i) {
+    if (i < 18)
+        return _DATA_STORE + 8 + i;
+    if (i < 20)
+        return _DATA_STORE + 28 + (i - 18);
+    if (i < 23)
+        return _DATA_STORE + 31 + (i - 20);
+    if (i < _PERSIST_ALARMS)
+        return _DATA_STORE + _DS_ALARM_EXT + (i - 23);
+#ifdef _TRIM
+    if (i == _PERSIST_ALARMS)
+        return (unsigned char *)&_TRIM_aging;
+#endif
+#ifdef _TEMP_COMP
+    if (i == _PERSIST_ALARMS + 1)
+        return (unsigned char *)&_TCOMP_turnover;
+    if (i == _PERSIST_ALARMS + 2)
+        return &_TCOMP_curve;
+#endif
+#ifdef _TEMP_HISTORY
+    if (i == _PERSIST_COUNT - _PERSIST_TALARM - 1)
+        return &_HIST_interval;
+#endif
+#ifdef _TEMP_ALARM
+    if (i >= _PERSIST_COUNT - _PERSIST_TALARM)
+        return _TALARM_reg + (i - (_PERSIST_COUNT - _PERSIST_TALARM));
+#endif
+    return (unsigned char *)&_I2C_pad;
+}
+
+unsigned char _persist_get(unsigned char i) {
+    if (i == 18)
+        return _DATA_STORE[28] & _PERSIST_CFG;
+    return *_persist_reg(i);
+}
+
+void _persist_set(unsigned char i, unsigned char value) {
+    if (i == 18)
+        _DATA_STORE[28] = (_DATA_STORE[28] & ~_PERSIST_CFG) | (value & _PERSIST_CFG);
+    else
+        *_persist_reg(i) = value;
+}
+
+/**
+ * Restore the registers from the newest complete segment
+ * Segment layout:
+ *      0:      _PERSIST_MARK, written last
+ *      1:      Sequence number, the highest one is the newest
+ *      2:      _PERSIST_COUNT
+ *      3:      _PERSIST_FEATURES
+ *      4~:     All registers, _PERSIST_COUNT bytes
+ *      then:   Records of register index and value, 0xFF: free
+ * Information flash outlives a reflash. Segments saved by a build with
+ * another register layout would put values in the wrong registers, so
+ * they are erased instead and the defaults stay.
+ * At most 64 bytes are read, so boot time stays bounded.
+ */
+void _persist_restore() {
+    unsigned char n, p;
+    unsigned char * seg;
+
+    for (n = 0; n < _INFO_SEG_COUNT; n++) {
+        seg = _INFO_SEG(n);
+        if (seg[0] != _PERSIST_MARK)
+            continue;
+        if (seg[2] != _PERSIST_COUNT || seg[3] != _PERSIST_FEATURES) {
+            _info_erase(seg);                   // Another layout
+            continue;
+        }
+        if (_PERSIST_seg == 0xFF ||
+                (signed char)(seg[1] - _INFO_SEG(_PERSIST_seg)[1]) > 0)
+            _PERSIST_seg = n;
+    }
+    if (_PERSIST_seg == 0xFF)
+        return;                                 // Never saved
+
+    seg = _INFO_SEG(_PERSIST_seg);
+    for (n = 0; n < _PERSIST_COUNT; n++)
+        _persist_set(n, seg[_PERSIST_HEAD + n]);
+    for (p = _PERSIST_HEAD + _PERSIST_COUNT; p + 1 < _INFO_SEG_SIZE && seg[p] != 0xFF; p += 2)
+        if (seg[p] < _PERSIST_COUNT)
+            _persist_set(seg[p], seg[p + 1]);
+    _PERSIST_free = p;
+#ifdef _TEMP_HISTORY
+    _HIST_countdown = _HIST_interval;
+#endif
+}
+
+/**
+ * Save the registers that differ from flash
+ * Changes are appended as records. When the segment is full all
+ * registers go to the next segment instead, so erases rotate over
+ * segments D, C and B.
+ */
+void _persist_flush() {
+    unsigned char i, p, value;
+    unsigned char record[2];
+    unsigned char * seg;
+
+    if (_PERSIST_seg == 0xFF) {
+        _persist_compact();
+        return;
+    }
+    seg = _INFO_SEG(_PERSIST_seg);
+    for (i = 0; i < _PERSIST_COUNT; i++) {
+        value = seg[_PERSIST_HEAD + i];         // Value in flash: image, then the last record
+        for (p = _PERSIST_HEAD + _PERSIST_COUNT; p < _PERSIST_free; p += 2)
+            if (seg[p] == i)
+                value = seg[p + 1];
+        record[1] = _persist_get(i);
+        if (record[1] == value)
+            continue;
+        if (_PERSIST_free + 2 > _INFO_SEG_SIZE) {
+            _persist_compact();
+            return;
+        }
+        record[0] = i;
+        _info_write(seg + _PERSIST_free, record, 2);
+        _PERSIST_free += 2;
+    }
+}
+
+/**
+ * Write all registers to the next segment
+ * The mark goes last, a segment cut short by a reset is ignored.
+ */
+void _persist_compact() {
+    unsigned char n, i, seq, value;
+    unsigned char * seg;
+    static const unsigned char layout[2] = { _PERSIST_COUNT, _PERSIST_FEATURES };
+
+    seq = 0;
+    n = 0;
+    if (_PERSIST_seg != 0xFF) {
+        seq = _INFO_SEG(_PERSIST_seg)[1] + 1;
+        n = _PERSIST_seg + 1;
+        if (n == _INFO_SEG_COUNT)
+            n = 0;
+    }
+    seg = _INFO_SEG(n);
+    _info_erase(seg);
+    for (i = 0; i < _PERSIST_COUNT; i++) {
+        value = _persist_get(i);
+        _info_write(seg + _PERSIST_HEAD + i, &value, 1);
+    }
+    _info_write(seg + 2, layout, 2);
+    _info_write(seg + 1, &seq, 1);
+    value = _PERSIST_MARK;
+    _info_write(seg, &value, 1);
+    _PERSIST_seg = n;
+    _PERSIST_free = _PERSIST_HEAD + _PERSIST_COUNT;
+}
+#endif
+
+#ifdef _EVENT_LOG
+/**
+ * Append a record to the event log
+ * The stamp is the low 24 bits of the seconds since 2000-01-01 (194 days).
+ * A full log keeps what it has and counts the new record as lost.
+ * Called from the main loop and from the I2C callbacks.
+ */
+void _log_event(unsigned char code) {
+    unsigned int sr;
+    unsigned char * record;
+    unsigned char i;
+
+    sr = __get_SR_register();
+    __disable_interrupt();
+    if (_LOG_count == _EVENT_LOG) {
+        if (_LOG_lost != 0xFF)
+            _LOG_lost++;
+    } else {
+        i = _LOG_tail + _LOG_count;
+        if (i >= _EVENT_LOG)
+            i -= _EVENT_LOG;
+        record = _LOG_ring + i * 4;
+        record[0] = code;
+        record[1] = _RTC_seconds >> 16;
+        record[2] = _RTC_seconds >> 8;
+        record[3] = _RTC_seconds;
+        _LOG_count++;
+    }
+    __bis_SR_register(sr & GIE);
+}
+
+/**
+ * Byte of the event log window for the TX callback
+ *      0x78:       Number of records held
+ *      0x79:       Records lost with the log full, write to clear
+ *      0x7A:       Stream, does not auto-increment. Sends the oldest
+ *                  record byte by byte, 4 bytes each: code, seconds
+ *                  stamp MSB~LSB. A record is gone once its last byte
+ *                  is sent. 0xFF with the log empty.
+ * Event codes: 0x01 power up, 0x02 time set, 0x20~0x3F Alarm1~32 fired
+ */
+unsigned char * _log_byte(unsigned char offset) {
+    if (offset == _LOG_BASE)
+        return &_LOG_count;
+    if (offset == _LOG_BASE + 1)
+        return &_LOG_lost;
+    _LOG_pos &= ~BIT7;
+    if (!_LOG_count)
+        return (unsigned char *)&_I2C_pad;
+    _LOG_pos |= BIT7;
+    return _LOG_ring + _LOG_tail * 4 + (_LOG_pos & 3);
+}
+
+/**
+ * The stream byte fetched last is on the bus, move past it
+ */
+void _log_consume() {
+    if (!(_LOG_pos & BIT7))
+        return;
+    _LOG_pos = (_LOG_pos & 3) + 1;
+    if (_LOG_pos == 4) {                    // Whole record sent
+        _LOG_pos = 0;
+        if (++_LOG_tail == _EVENT_LOG)
+            _LOG_tail = 0;
+        _LOG_count--;
+    }
+}
+#endif
+
+#ifdef _TIMERS
+/**
+ * Period of timer n in seconds, 0 counts as 1
+ */
+unsigned long _timer_period(unsigned char n) {
+    unsigned long period;
+    period = _TIMER_reg[n * 3] | ((unsigned int)_TIMER_reg[n * 3 + 1] << 8);
+    if (!period)
+        period = 1;
+    if (_TIMER_reg[n * 3 + 2] & _TIMER_MINUTES)
+        period *= 60;
+    return period;
+}
+
+/**
+ * Start the timers the host asked for, called after a control write
+ */
+void _timer_start() {
+    unsigned char n;
+    for (n = 0; n < _TIMERS; n++) {
+        if (!(_TIMER_reg[n * 3 + 2] & _TIMER_START))
+            continue;
+        _TIMER_due[n] = _RTC_seconds + _timer_period(n);
+        _TIMER_reg[n * 3 + 2] &= ~_TIMER_START;
+    }
+    _timer_schedule();
+}
+
+/**
+ * Fire the timers due this second, called when _RTC_seconds reaches _TIMER_next
+ * Timer registers, 3 bytes each from 0x64:
+ *      +0, +1: Period LSB, MSB. Up to 65535 seconds or minutes (45 days),
+ *              used from the next start or reload
+ *      +2:     Control, after the period so one write sets up and starts
+ *              BIT7: Running. Writing 1 to a stopped timer starts it from now,
+ *                    write 0 first to restart a running one
+ *              BIT6: Periodic, reloads when it fires. Otherwise stops
+ *              BIT5: Period in minutes, otherwise in seconds
+ *              BIT4: Fired flag, can only be cleared by host
+ *              BIT2: Start pending, reads 1 until the main loop starts it
+ *              BIT1: Pulse P1.4 while the flag is set
+ *              BIT0: Pulse P1.5 while the flag is set, as for alarms
+ * A timer fires on the period-th second boundary after it was started,
+ * so the first period is up to a second short.
+ * Setting the time moves the timers along, they count elapsed time.
+ * Only _TIMER_next is compared each second, timers are not scanned.
+ */
+void _timer_fire() {
+    unsigned char n;
+    for (n = 0; n < _TIMERS; n++) {
+        if (!(_TIMER_reg[n * 3 + 2] & _TIMER_ON) || _TIMER_due[n] != _RTC_seconds)
+            continue;
+        _TIMER_reg[n * 3 + 2] |= _TIMER_FIRED;
+#ifdef _EVENT_LOG
+        _log_event(_LOG_TIMER + n);
+#endif
+        if (_TIMER_reg[n * 3 + 2] & _TIMER_PERIODIC)
+            _TIMER_due[n] += _timer_period(n);
+        else
+            _TIMER_reg[n * 3 + 2] &= ~_TIMER_ON;
+    }
+    _timer_schedule();
+}
+
+/**
+ * Find the earliest running timer
+ * Dues are compared relative to now, so the 32 bit wrap does no harm.
+ */
+void _timer_schedule() {
+    unsigned long next = 0xFFFFFFFF, left;
+    unsigned char n;
+    for (n = 0; n < _TIMERS; n++) {
+        if (!(_TIMER_reg[n * 3 + 2] & _TIMER_ON) || (_TIMER_reg[n * 3 + 2] & _TIMER_START))
+            continue;
+        left = _TIMER_due[n] - _RTC_seconds;
+        if (left < next)
+            next = left;
+    }
+    _TIMER_next = next == 0xFFFFFFFF ? next : _RTC_seconds + next;
+}
+#endif
+
+#ifdef _CAPTURE
+/**
+ * Select the edges of P1.2 to capture, 0 turns the capture off
+ */
+void _cap_mode(unsigned char mode) {
+    _CAP_edges = mode & 3;
+    if (_CAP_edges)
+        TACCTL1 = (_CAP_edges << 14) + CCIS_0 + SCS + CAP + CCIE;   // CM_1~CM_3 on CCI1A
+    else
+        TACCTL1 = 0;
+}
+
+/**
+ * Byte of the edge capture window for the TX callback
+ *      0x70:       Number of entries held
+ *      0x71:       Edges lost with the FIFO full or missed, write to clear
+ *      0x72:       Stream, does not auto-increment. Sends the oldest
+ *                  entry byte by byte, 4 bytes each: seconds MSB, LSB,
+ *                  fraction MSB, LSB. An entry is gone once its last
+ *                  byte is sent. 0xFF with the FIFO empty.
+ *      0x73:       Edges to capture, 0 off, 1 rising, 2 falling, 3 both
+ * Seconds are the low 16 bits of the seconds since 2000-01-01, the
+ * fraction is in 1/32768s as in 0x7E, 0x7F.
+ */
+unsigned char * _cap_byte(unsigned char offset) {
+    if (offset == _CAP_BASE)
+        return &_CAP_count;
+    if (offset == _CAP_BASE + 1)
+        return &_CAP_lost;
+    if (offset == _CAP_BASE + 3)
+        return &_CAP_edges;
+    _CAP_pos &= ~BIT7;
+    if (!_CAP_count)
+        return (unsigned char *)&_I2C_pad;
+    _CAP_pos |= BIT7;
+    return _CAP_ring + _CAP_tail * 4 + (_CAP_pos & 3);
+}
+
+/**
+ * The stream byte fetched last is on the bus, move past it
+ */
+void _cap_consume() {
+    if (!(_CAP_pos & BIT7))
+        return;
+    _CAP_pos = (_CAP_pos & 3) + 1;
+    if (_CAP_pos == 4) {                    // Whole entry sent
+        _CAP_pos = 0;
+        if (++_CAP_tail == _CAPTURE)
+            _CAP_tail = 0;
+        _CAP_count--;
+    }
+}
+#endif
+
+#ifdef _DIAG
+/**
+ * Account one run of ISR n that started at timer count entry
+ */
+void _diag_isr(unsigned char n, unsigned short entry) {
+    unsigned short ticks = TAR - entry;
+
+    _DIAG_calls[n]++;
+    _DIAG_ticks[n] += ticks;
+    if (ticks > _DIAG_max[n])
+        _DIAG_max[n] = ticks > 0xFF ? 0xFF : ticks;
+}
+
+/**
+ * Account the action bits the last main loop pass cleared
+ * bits: _RTC_action_bits in the low byte, _RTC_action_bits2 in the high
+ * byte. The wait is counted from the wake up, so it covers the ISR work
+ * after it, the queue and the handler itself.
+ */
+void _diag_serviced(unsigned int bits) {
+    unsigned short wait;
+    unsigned char i;
+
+    if (!bits)
+        return;
+    wait = TAR - _RES_mark;
+    if (wait > 0xFF)
+        wait = 0xFF;
+    for (i = 0; i < 16; i++, bits >>= 1)
+        if ((bits & 1) && wait > _DIAG_wait[i])
+            _DIAG_wait[i] = wait;
+}
+
+/**
+ * Byte of the diagnostics window for the TX callback, little endian
+ * Times are in ACLK counts of 30.5us, so a short ISR mostly counts 0
+ * and sometimes 1. The sums still give the average over many calls.
+ *      0xC0~0xD3:  Per ISR, Timer_A0, USI, ADC10, Timer_A1: calls (2),
+ *                  counts spent (2), longest run (1). Timer_A1 only
+ *                  with _UART_OUTPUT or _CAPTURE
+ *      0xD4~0xE3:  Longest wait from wake up to service per action bit,
+ *                  _RTC_action_bits BIT0~7, then _RTC_action_bits2 BIT0~7
+ *      0xE4~0xE7:  Counts with the CPU on in the main loop
+ *      0xE8~0xEB:  Counts asleep in LPM3
+ * Calls and counts wrap, the host takes differences. The rest saturates
+ * at 0xFF. Writing any byte of the window clears all of it.
+ * A 16 bit value may tear if an interrupt lands between its bytes.
+ */
+unsigned char * _diag_byte(unsigned char offset) {
+    unsigned char n;
+
+    offset -= _DIAG_BASE;
+    if (offset < 20) {
+        n = offset / 5;
+        if (n >= _DIAG_ISRS)
+            return (unsigned char *)&_I2C_pad;
+        offset -= n * 5;
+        if (offset < 2)
+            return (unsigned char *)&_DIAG_calls[n] + offset;
+        if (offset < 4)
+            return (unsigned char *)&_DIAG_ticks[n] + offset - 2;
+        return _DIAG_max + n;
+    }
+    if (offset < 36)
+        return _DIAG_wait + offset - 20;
+    if (offset < 40)
+        return (unsigned char *)&_RES_active + offset - 36;
+    if (offset < 44)
+        return (unsigned char *)&_RES_LPM3 + offset - 40;
+    return (unsigned char *)&_I2C_pad;
+}
+
+/**
+ * Start a new measurement window
+ */
+void _diag_clear() {
+    unsigned char i;
+
+    for (i = 0; i < _DIAG_ISRS; i++) {
+        _DIAG_calls[i] = 0;
+        _DIAG_ticks[i] = 0;
+        _DIAG_max[i] = 0;
+    }
+    for (i = 0; i < 16; i++)
+        _DIAG_wait[i] = 0;
+    _RES_active = 0;
+    _RES_LPM3 = 0;
+}
+#endif
+
+/**
+ * Set the offset from the first byte of a write, within the selected page
+ * Bank select register at 0xFF of every page:
+ *      BIT2~0: Page, see _PAGE_base. 0 after reset, all registers at their
+ *              usual offsets
+ *      BIT6:   Reads 1 once an access ran past the end of the page, kept
+ *              until the next access to another offset
+ *      BIT7:   Wrap to offset 0 of the page at its end. Otherwise reads past
+ *              the end return 0xFF and writes are NACKed
+ * The bank select does not auto-increment, further bytes read or write it again.
+ * Pages let a host take a whole block such as the history or the
+ * diagnostics in one burst from offset 0, and keep bursts within bounds.
+ */
+void _i2c_seek(unsigned char offset) {
+    unsigned char page = _I2C_page & _PAGE_SELECT;
+
+    if (offset == _PAGE_BANK) {             // Keeps the past end flag of the last access
+        _I2C_data_offset = _PAGE_BANK;
+        return;
+    }
+    _I2C_page &= ~_PAGE_PAST;
+    if (offset < _PAGE_size[page]) {
+        _I2C_data_offset = _PAGE_base[page] + offset;
+        _I2C_end = _PAGE_base[page] + _PAGE_size[page];
+    } else {
+        _I2C_page |= _PAGE_PAST;
+    }
+}
+
+/**
+ * Auto-increment reached the end of the page, wrap or stop
+ * Called from _I2C_ADVANCE() only, the offset is checked inline as
+ * this runs for every byte on the bus.
+ */
+void _i2c_page_end() {
+    unsigned char page = _I2C_page & _PAGE_SELECT;
+
+    if (_I2C_page & _PAGE_WRAP) {
+        _I2C_data_offset = _PAGE_base[page];
+        return;
+    }
+    _I2C_page |= _PAGE_PAST;
+}
+
+/**
+ * Whether page 0 has a register at the offset
+ * The RX callback runs while the following byte is on the bus, so it
+ * looks at the offset that byte goes to and refuses it in time for
+ * its NACK. Read only registers count, writes to them are ACKed and
+ * ignored.
+ */
+unsigned char _i2c_mapped(unsigned char offset) {
+    if (offset < _DS_SIZE || offset == _PAGE_BANK)
+        return 1;
+#ifdef _TIMERS
+    if (offset >= _TIMER_BASE && offset < _TIMER_BASE + _TIMERS * 3)
+        return 1;
+#endif
+#ifdef _CAPTURE
+    if (offset >= _CAP_BASE && offset <= _CAP_BASE + 3)
+        return 1;
+#endif
+    if (offset >= _UNIX_BASE && offset < _UNIX_BASE + 4)
+        return 1;
+#ifdef _EVENT_LOG
+    if (offset >= _LOG_BASE && offset <= _LOG_STREAM)
+        return 1;
+#endif
+#ifdef _TRIM
+    if (offset == _TRIM_BASE)
+        return 1;
+#endif
+#ifdef _TEMP_COMP
+    if (offset == _TCOMP_BASE || offset == _TCOMP_BASE + 1)
+        return 1;
+#endif
+    if (offset == _SUBSEC_BASE || offset == _SUBSEC_BASE + 1)
+        return 1;
+#ifdef _TEMP_HISTORY
+    if (offset >= _HIST_BASE && offset < _HIST_BASE + 2 + 4 * _TEMP_HISTORY)
+        return 1;
+#endif
+#ifdef _DIAG
+    if (offset >= _DIAG_BASE && offset < _DIAG_BASE + 44)
+        return 1;
+#endif
+#ifdef _TEMP_ALARM
+    if (offset >= _TALARM_BASE && offset < _TALARM_BASE + 3)
+        return 1;
+#endif
+    return offset == _CELSIUS_BASE || offset == _CELSIUS_BASE + 1;
+}
+
+/***********************************************
+ * Mandatory functions for callback
+ * You can modify codes in these functions
+ *         to deal with data received
+ *         or data to be sent
+ *         but left function name unchanged
+ ***********************************************/
+unsigned char * USI_I2C_slave_TX_callback() {
+    unsigned char _I2C_data_offset_1, i;
+    _I2C_data_offset_1 = _I2C_data_offset;
+    // Called one byte ahead. The byte fetched last time is on the bus now,
+    // the one fetched here is only sent if the master ACKs that one.
+    if (_I2C_TX_last == 26)                 // User reading the high part of the temperature result
+        _TEMP_state |= _TEMP_READ;
+    if (_I2C_TX_last == 27 &&
+            (_TEMP_state & _TEMP_READ)) {   // User reading the low part of the temperature result
+        _DATA_STORE[28] &= ~BIT5;           // Clear temperature data ready bit
+        _TEMP_state &= ~_TEMP_READ;
+    }
+#ifdef _EVENT_LOG
+    if (_I2C_TX_last == _LOG_STREAM)
+        _log_consume();
+#endif
+#ifdef _CAPTURE
+    if (_I2C_TX_last == _CAP_STREAM)
+        _cap_consume();
+#endif
+#ifdef _TEMP_HISTORY
+    if (_I2C_TX_last >= _HIST_BASE + 2 &&
+            ((_I2C_TX_last - _HIST_BASE - 2) & 3) == 3) {  // Last byte of a history entry
+        i = ((_I2C_TX_last - _HIST_BASE - 2) >> 2) + 1;
+        if (i <= _HIST_count && i > _HIST_taken)
+            _HIST_taken = i;
+    }
+#endif
+    if (_I2C_data_offset_1 == _PAGE_BANK) {
+        _I2C_TX_last = 0xFF;
+        return &_I2C_page;
+    }
+    if (_I2C_page & _PAGE_PAST) {           // Ran past the end of the page
+        _I2C_TX_last = 0xFF;
+        return (unsigned char *)&_I2C_pad;
+    }
+    _I2C_TX_last = _I2C_data_offset_1;
+    if (_I2C_data_offset_1 < 8 || (_I2C_data_offset_1 >= _UNIX_BASE &&
+            _I2C_data_offset_1 < _UNIX_BASE + 4)) {    // Time registers as at START
+        _I2C_ADVANCE();
+        return _time_byte(_I2C_data_offset_1);
+    }
+#ifdef _EVENT_LOG
+    if (_I2C_data_offset_1 >= _LOG_BASE &&
+            _I2C_data_offset_1 <= _LOG_STREAM) {
+        if (_I2C_data_offset_1 != _LOG_STREAM)
+            _I2C_ADVANCE();
+        return _log_byte(_I2C_data_offset_1);
+    }
+#endif
+#ifdef _TIMERS
+    if (_I2C_data_offset_1 >= _TIMER_BASE &&
+            _I2C_data_offset_1 < _TIMER_BASE + _TIMERS * 3) {
+        _I2C_ADVANCE();
+        return _TIMER_reg + (_I2C_data_offset_1 - _TIMER_BASE);
+    }
+#endif
+#ifdef _CAPTURE
+    if (_I2C_data_offset_1 >= _CAP_BASE &&
+            _I2C_data_offset_1 <= _CAP_BASE + 3) {
+        if (_I2C_data_offset_1 != _CAP_STREAM)
+            _I2C_ADVANCE();
+        return _cap_byte(_I2C_data_offset_1);
+    }
+#endif
+    if (_I2C_data_offset_1 == _SUBSEC_BASE || _I2C_data_offset_1 == _SUBSEC_BASE + 1) {
+        _I2C_ADVANCE();
+        return _TIME_sub + (_I2C_data_offset_1 - _SUBSEC_BASE);
+    }
+#ifdef _TRIM
+    if (_I2C_data_offset_1 == _TRIM_BASE) {
+        _I2C_ADVANCE();
+        return (unsigned char *)&_TRIM_aging;
+    }
+#endif
+#ifdef _TEMP_COMP
+    if (_I2C_data_offset_1 == _TCOMP_BASE) {
+        _I2C_ADVANCE();
+        return (unsigned char *)&_TCOMP_turnover;
+    }
+    if (_I2C_data_offset_1 == _TCOMP_BASE + 1) {
+        _I2C_ADVANCE();
+        return &_TCOMP_curve;
+    }
+#endif
+    if (_I2C_data_offset_1 == _CELSIUS_BASE || _I2C_data_offset_1 == _CELSIUS_BASE + 1) {
+        _I2C_ADVANCE();
+        return (unsigned char *)&_TEMP_celsius + (_CELSIUS_BASE + 1 - _I2C_data_offset_1);
+    }
+#ifdef _TEMP_ALARM
+    if (_I2C_data_offset_1 >= _TALARM_BASE && _I2C_data_offset_1 < _TALARM_BASE + 3) {
+        _I2C_ADVANCE();
+        return _TALARM_reg + (_I2C_data_offset_1 - _TALARM_BASE);
+    }
+#endif
+#ifdef _DIAG
+    if (_I2C_data_offset_1 >= _DIAG_BASE) {
+        _I2C_ADVANCE();
+        return _diag_byte(_I2C_data_offset_1);
+    }
+#endif
+#ifdef _TEMP_HISTORY
+    if (_I2C_data_offset_1 >= _HIST_BASE) {
+        _I2C_ADVANCE();
+        return _temp_history_byte(_I2C_data_offset_1 - _HIST_BASE);
+    }
+#endif
+    _I2C_ADVANCE();
+    if (_I2C_data_offset_1 < _DS_SIZE)
+        return _DATA_STORE + _I2C_data_offset_1;
+    return (unsigned char *)&_I2C_pad;      // Nothing at this offset
+}
+
+unsigned char USI_I2C_slave_RX_callback(unsigned char * byte) {
+    unsigned char byte_data, old, r;
+#ifdef _TIMERS
+    unsigned char i;
+#endif
+    byte_data = *byte;
+    if (!_USI_I2C_slave_n_byte) {
+        _i2c_seek(byte_data);
+        _USI_I2C_slave_n_byte = 1;
+    } else {
+        if (_I2C_data_offset == _PAGE_BANK) {
+            _I2C_page = byte_data & (_PAGE_SELECT + _PAGE_WRAP);
+            return 0;
+        }
+        if (_I2C_page & _PAGE_PAST)             // Refused already, not expected here
+            return 1;
+        if (_I2C_data_offset < _DS_SIZE) {      // Data store, see _REG_hook
+            r = _I2C_data_offset < _DS_ALARM_EXT ? _I2C_data_offset : 8;
+            old = _DATA_STORE[_I2C_data_offset];
+            byte_data ^= (byte_data ^ old) & _REG_keep[r];
+            byte_data &= old | ~_REG_clear[r];
+            switch (__even_in_range(_REG_hook[r], _HOOK_CONFIG)) {
+            case _HOOK_NONE:
+                break;
+            case _HOOK_TIME:                    // Staged until STOP
+                _time_stage(0, _I2C_data_offset, byte_data);
+                byte_data = old;
+                break;
+            case _HOOK_ALARM:                   // Rebuild the index
+                _RTC_action_bits2 |= BIT5;
+                _USI_I2C_slave_wake = 1;
+                break;
+            case _HOOK_CONFIG:
+                if (byte_data & BIT4) {         // Commit staged time in the main loop
+                    _RTC_action_bits2 |= BIT3;
+                    _USI_I2C_slave_wake = 1;
+                    byte_data &= ~BIT4;
+                }
+                if (byte_data & BIT6) {         // Temperature convert requested
+                    _RTC_action_bits2 |= BIT4;
+                    _USI_I2C_slave_wake = 1;
+                }
+                if ((byte_data ^ old) & _SQW_MASK) {    // Square wave select changed
+                    _DATA_STORE[28] = byte_data;
+                    _sqw_mode();
+                }
+                break;
+            }
+            _DATA_STORE[_I2C_data_offset] = byte_data;
+        } else {
+            switch(_I2C_data_offset) {
+#ifdef _CAPTURE
+            case _CAP_BASE:     // Edge capture, the lost count and the edges can be written
+            case _CAP_STREAM:
+                break;
+            case _CAP_BASE + 1:
+                _CAP_lost = 0;
+                break;
+            case _CAP_BASE + 3:
+                _cap_mode(byte_data);
+                break;
+#endif
+            case _UNIX_BASE:    // Staged until STOP as bytes 0~7
+            case _UNIX_BASE + 1:
+            case _UNIX_BASE + 2:
+            case _UNIX_BASE + 3:
+                _time_stage(1, _I2C_data_offset - _UNIX_BASE, byte_data);
+                break;
+            case _SUBSEC_BASE:  // Read only
+            case _SUBSEC_BASE + 1:
+            case _CELSIUS_BASE:
+            case _CELSIUS_BASE + 1:
+                break;
+#ifdef _TEMP_ALARM
+            case _TALARM_BASE:  // New threshold, rearmed
+                _TALARM_reg[0] = byte_data;
+                _TEMP_state &= ~_TEMP_HIGH;
+                break;
+            case _TALARM_BASE + 1:
+                _TALARM_reg[1] = byte_data;
+                _TEMP_state &= ~_TEMP_LOW;
+                break;
+            case _TALARM_BASE + 2:
+                _TALARM_reg[2] = byte_data;
+                break;
+#endif
+#ifdef _EVENT_LOG
+            case _LOG_BASE:     // Event log, only the lost count can be written
+            case _LOG_STREAM:
+                break;
+            case _LOG_BASE + 1:
+                _LOG_lost = 0;
+                break;
+#endif
+#ifdef _TRIM
+            case _TRIM_BASE:
+                _TRIM_aging = byte_data;
+                _trim_update();
+                break;
+#endif
+#ifdef _TEMP_COMP
+            case _TCOMP_BASE:   // New curve, take a sample for it now
+            case _TCOMP_BASE + 1:
+                if (_I2C_data_offset == _TCOMP_BASE)
+                    _TCOMP_turnover = byte_data;
+                else
+                    _TCOMP_curve = byte_data;
+                _TEMP_state |= _TEMP_COMP_DUE;
+                _RTC_action_bits2 |= BIT4;
+                _USI_I2C_slave_wake = 1;
+                break;
+#endif
+#ifdef _TEMP_HISTORY
+            case _HIST_BASE:    // Sample interval, first sample one interval from now
+                _HIST_interval = byte_data;
+                _HIST_countdown = byte_data;
+                break;
+#endif
+            default:
+#ifdef _DIAG
+                if (_I2C_data_offset >= _DIAG_BASE) {       // Any write starts a new window
+                    _diag_clear();
+                    break;
+                }
+#endif
+#ifdef _TEMP_HISTORY
+                if (_I2C_data_offset >= _HIST_BASE)         // Read only
+                    break;
+#endif
+#ifdef _TIMERS
+                if (_I2C_data_offset >= _TIMER_BASE &&
+                        _I2C_data_offset < _TIMER_BASE + _TIMERS * 3) {
+                    i = _I2C_data_offset - _TIMER_BASE;
+                    if (i % 3 != 2) {               // Period
+                        _TIMER_reg[i] = byte_data;
+                        break;
+                    }
+                    if (byte_data & ~_TIMER_reg[i] & _TIMER_ON)
+                        byte_data |= _TIMER_START;  // Stopped before, start it
+                    else
+                        byte_data = (byte_data & ~_TIMER_START) | (_TIMER_reg[i] & _TIMER_START);
+                    byte_data &= _TIMER_reg[i] | ~_TIMER_FIRED;     // Flag can only be cleared
+                    _TIMER_reg[i] = byte_data;
+                    _RTC_action_bits |= BIT7;       // Start or stop in the main loop
+                    _USI_I2C_slave_wake = 1;
+                    break;
+                }
+#endif
+                return 1;                       // Nothing at this offset
+            }
+        }
+#ifdef _PERSIST
+        if (_I2C_data_offset >= 8) {            // Maybe a register kept in flash
+            _RTC_action_bits2 |= BIT6;
+            _USI_I2C_slave_wake = 1;
+        }
+#endif
+        _I2C_ADVANCE();
+    }
+    // Refuse the following byte already if nothing takes it
+    if (_I2C_data_offset == _PAGE_BANK)     // Past end flag is kept for reads
+        return 0;
+    if (_I2C_page & _PAGE_PAST)
+        return 1;
+    if (_I2C_data_offset >= _DS_SIZE && !(_I2C_page & _PAGE_SELECT)
+        && !_i2c_mapped(_I2C_data_offset))
+        return 1;
+    if ((_TIME_stage_mask & _TIME_UNIX) ? _I2C_data_offset < 8 :
+            _TIME_stage_mask && _I2C_data_offset >= _UNIX_BASE && _I2C_data_offset < _UNIX_BASE + 4)
+        return 1;                           // The other time view, see _time_stage()
+    return 0;   // 0: No error; Not 0: Error in received data
+}
+
+void _USI_I2C_slave_reset_byte_count() {
+    unsigned short sub;
+    unsigned char i;
+
+    _CLK_state |= _CLK_I2C;                 // Up to the ceiling for the transaction
+    _clock_set(1);
+    _USI_I2C_slave_n_byte = 0;
+    // Copy the time for the reads in this transaction, nothing is staged
+    // here as _USI_I2C_slave_hold keeps the START until the commit
+    _TIME_buff[0] = _RTC_second;
+    _TIME_buff[1] = _RTC_minute;
+    _TIME_buff[2] = _RTC_minute >> 8;
+    for (i = 3; i < 8; i++)
+        _TIME_buff[i] = _DATA_STORE[i];
+    sub = TAR - _RTC_tick;
+    if (_RTC_action_bits & BIT0)            // Increment not counted yet, the time is a second behind
+        sub += _second_div;
+    if (sub >= _second_div)                 // Next second started, its interrupt waits for this one
+        sub = _second_div - 1;
+    _TIME_frac = sub;
+    if (_I2C_TX_last != 0xFF) {             // The byte fetched ahead in the last read was not sent
+        _I2C_data_offset = _I2C_TX_last;
+        _I2C_TX_last = 0xFF;
+        _I2C_page &= ~_PAGE_PAST;
+    }
+#ifdef _TEMP_HISTORY
+    if (_HIST_taken) {                      // Drop the entries read in the last transaction
+        _HIST_tail += _HIST_taken;
+        if (_HIST_tail >= _TEMP_HISTORY)
+            _HIST_tail -= _TEMP_HISTORY;
+        _HIST_count -= _HIST_taken;
+        _HIST_taken = 0;
+    }
+#endif
+}
+
+/**
+ * A START came while time bytes are staged, the USI holds it
+ * The main loop commits them and resumes the START, so the next
+ * transaction sees the new time.
+ */
+void _USI_I2C_slave_held() {
+    _RTC_action_bits2 |= BIT3;
+}
+//**********************************************/
+
+#ifdef _UART_OUTPUT
+/**
+ * Extra functions for software UART
+ */
+void _UART_TX_byte(unsigned char byte) {
+    unsigned char fill = (_UART_head - _UART_tail) & (_UART_QUEUE_SIZE - 1);
+    if (fill == _UART_QUEUE_SIZE - 1) { // Queue full, never wait for it
+        if (_UART_dropped != 0xFFFF)
+            _UART_dropped++;
+        return;
+    }
+    if (++fill > _UART_peak)
+        _UART_peak = fill;
+    _UART_queue[_UART_head] = byte;
+    _UART_head = (_UART_head + 1) & (_UART_QUEUE_SIZE - 1);
+
+    if (!(TACCTL1 & CCIE)) {            // Transmitter idle, start it
+        __disable_interrupt();
+        _UART_n_bit = 0;                // Timer_A1 loads the byte
+        _UART_frac = 0;
+        while (TACCR1 != TAR)           // Prevent async capture
+            TACCR1 = TAR;               // Current state of TA counter
+        TACCR1 += _UART_period >> 8;    // Some time till first bit
+        TACCTL1 = (OUTMOD0 + CCIE);     // TXD = mark = idle
+        __enable_interrupt();
+    }
+}
+
+void _UART_send_datetime() {
+    unsigned int idx = 8;
     unsigned char byte_h, byte_l;
+    _time_materialize();
     while(idx) {
         byte_h = _DATA_STORE[idx - 1] >> 4;
         byte_l = _DATA_STORE[idx - 1] << 4;
@@ -591,45 +2476,56 @@ void _UART_send_datetime() {
 #endif
 
 /**
- * The timer capture interrupt is set to happen every 0.5s
+ * The timer capture interrupt only happens for scheduled events
  */
 #pragma vector=TIMER0_A0_VECTOR
 __interrupt void Timer_A0(void) {
-    TACCR0 += _second_div;
+    unsigned char due;
+#ifdef _TRIM
+    int trim;
+#endif
+    _DIAG_ENTER();
 
-    _second_tick++; // Increment the ticker
-    switch (_second_tick) {
-    case 2:
-        _RTC_action_bits |= BIT4;   // Let's check alarm interrupt flag and output interrupt
-        break;
-    case 4:
+    due = _sched_take_due();
+    if (due & _EV_BIT(_EV_SECOND)) {
+        _RTC_tick = _sched_time[_EV_SECOND];
+#ifdef _TRIM
+        trim = _TRIM_frac + _TRIM_rate;
+        _TRIM_frac = trim & 0xFF;
+        _sched_at(_EV_SECOND, _sched_time[_EV_SECOND] + _second_div + (trim >> 8));  // Arithmetic shift, rounds down
+#else
+        _sched_at(_EV_SECOND, _sched_time[_EV_SECOND] + _second_div);
+#endif
+        if ((_DATA_STORE[28] & _SQW_MASK) == _SQW_1HZ)
+            P1OUT |= BIT0;          // 1-Hz output rising edge
+        _RTC_action_bits |= (BIT0 + BIT4);  // Time increment, then alarm interrupt output
 #ifdef _UART_OUTPUT
         _RTC_action_bits |= BIT1;   // Let's send out data to UART
 #endif
-        break;
-    case 6:
-        _RTC_action_bits |= BIT5;   // Reset alarm interrupt output after 4 division period
-        break;
-    case 8:
-        // Toggle P1.0 output level every 0.5s
-        // to form a full 1-Hz square wave output
-        P1OUT ^= BIT0;
-        break;
-    case 10:
         _RTC_action_bits2 |= BIT0;  // Send temperature ready interrupt if applicable
-        break;
-    case 12:
-        _RTC_action_bits |= BIT0;   // Let's do time increment now
-        break;
-    case 14:
+    }
+    if (due & _EV_BIT(_EV_HALF)) {
+        if ((_DATA_STORE[28] & _SQW_MASK) == _SQW_1HZ)    // Not rescheduled once 1-Hz is off
+            _sched_at(_EV_HALF, _sched_time[_EV_SECOND] + _half_second);  // Half way into the next second
+        P1OUT &= ~BIT0;             // 1-Hz output falling edge
+    }
+    if (due & _EV_BIT(_EV_PULSE_END)) {
+        _RTC_action_bits |= BIT5;   // Reset alarm interrupt output
         _RTC_action_bits2 |= BIT1;  // Reset temperature ready interrupt
-        break;
-    case 16:
-        // Toggle P1.0 output level every 0.5s
-        // to form a full 1-Hz square wave output
-        P1OUT ^= BIT0;
-        _second_tick = 0;   // Reset ticker
     }
+    if (due & _EV_BIT(_EV_PERSIST))
+        _RTC_action_bits2 |= BIT7;  // Save registers to flash
+    if ((due & _EV_BIT(_EV_I2C_STOP)) && _TIME_stage_mask) {
+        if (USICTL1 & USISTP)       // Time write finished, commit in main loop
+            _RTC_action_bits2 |= BIT3;
+        else
+            _sched_at(_EV_I2C_STOP, TAR + _stop_poll_ticks);   // From now, this run may be late
+    }
+    _sched_arm();
+
+    if (_RTC_action_bits | _RTC_action_bits2)
+        __bic_SR_register_on_exit(LPM3_bits);   // Work posted, wake the main loop
+    _DIAG_EXIT(_DIAG_TA0);
 }
 
 #ifdef _UART_OUTPUT
@@ -638,26 +2534,93 @@ __interrupt void Timer_A0(void) {
  */
 #pragma vector=TIMER0_A1_VECTOR
 __interrupt void Timer_A1(void) {
+    unsigned int frac;
+    _DIAG_ENTER();
+
     // We only honor TACCR1 interrupt
     // for UART TX
     if (TAIV == 0x02) {
-        TACCR1 += _UART_period_1200;
+        frac = _UART_frac + (_UART_period & 0xFF);
+        _UART_frac = frac;
+        TACCR1 += (_UART_period >> 8) + (frac >> 8);
+        if (_UART_n_bit == 0) {         // Stop bit done, take the next byte
+            if (_UART_head == _UART_tail) {
+                TACCTL1 &= ~CCIE;       // Queue empty, TXD stays at mark
+                _DIAG_EXIT(_DIAG_TA1);
+                return;
+            }
+            _UART_TX_data = (_UART_queue[_UART_tail] | 0x100) << 1; // Add stop and start bits
+            _UART_tail = (_UART_tail + 1) & (_UART_QUEUE_SIZE - 1);
+            _UART_n_bit = 0xA;
+        }
         // Code bases on TI's example
-        if (_UART_n_bit == 0)
-            TACCTL1 &= ~CCIE;           // All bits TXed, disable interrupt
-        else {
-            TACCTL1 |= OUTMOD2;         // TX Space
-            if (_UART_TX_data & 0x01)
-                TACCTL1 &= ~OUTMOD2;    // TX Mark
-            _UART_TX_data = _UART_TX_data >> 1;
-            _UART_n_bit--;
+        TACCTL1 |= OUTMOD2;             // TX Space
+        if (_UART_TX_data & 0x01)
+            TACCTL1 &= ~OUTMOD2;        // TX Mark
+        _UART_TX_data = _UART_TX_data >> 1;
+        _UART_n_bit--;
+    }
+    _DIAG_EXIT(_DIAG_TA1);
+}
+#endif
+
+#ifdef _CAPTURE
+/**
+ * Interrupt for edges captured on P1.2
+ * Timer_A0 has the higher priority, so the start of the second may
+ * have moved past the captured count. Such an edge belongs to the
+ * second before.
+ */
+#pragma vector=TIMER0_A1_VECTOR
+__interrupt void Timer_A1(void) {
+    unsigned short seconds, frac;
+    unsigned char * entry;
+    unsigned char i;
+    _DIAG_ENTER();
+
+    if (TAIV == 0x02) {
+        frac = TACCR1 - _RTC_tick;
+        seconds = (unsigned short)_RTC_seconds;
+        if (_RTC_action_bits & BIT0)    // Second started but not counted yet
+            seconds++;
+        if (frac >= 0xC000) {           // Before _RTC_tick
+            frac += _second_div;
+            seconds--;
+        } else if (frac >= _second_div) {   // Trimmed second a few counts long
+            frac = _second_div - 1;
+        }
+        if (TACCTL1 & COV) {            // Edge overwritten before this interrupt
+            TACCTL1 &= ~COV;
+            if (_CAP_lost != 0xFF)
+                _CAP_lost++;
+        }
+        if (_CAP_count == _CAPTURE) {
+            if (_CAP_lost != 0xFF)
+                _CAP_lost++;
+            _DIAG_EXIT(_DIAG_TA1);
+            return;
         }
+        i = _CAP_tail + _CAP_count;
+        if (i >= _CAPTURE)
+            i -= _CAPTURE;
+        entry = _CAP_ring + i * 4;
+        entry[0] = seconds >> 8;
+        entry[1] = seconds;
+        entry[2] = frac >> 8;
+        entry[3] = frac;
+        _CAP_count++;
     }
+    _DIAG_EXIT(_DIAG_TA1);
 }
 #endif
 
 // ADC10 interrupt service routine for temperature convert
 #pragma vector=ADC10_VECTOR
 __interrupt void ADC10_ISR(void) {
+    _DIAG_ENTER();
+    ADC10CTL0 &= ~ENC;          // Stop now, averaged conversions would repeat
+    ADC10CTL1 &= ~CONSEQ_2;
     _RTC_action_bits |= BIT6;   // Temperature convert finished. Go on transfer data.
+    __bic_SR_register_on_exit(LPM3_bits);
+    _DIAG_EXIT(_DIAG_ADC10);
 }
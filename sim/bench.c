@@ -0,0 +1,941 @@
+/*
+ * Benchmark scenarios for the host simulator
+ *
+ * HouYu Li <karajan_ii@hotmail.com>
+ *
+ * No license applied. Use as you wish.
+ *
+ * Every scenario runs in its own process so that it starts from a
+ * freshly reset firmware image. A failed check prints FAIL and the
+ * exit status is 1 when any scenario failed.
+ *
+ * Usage: rtc_sim [scenario ...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#include "sim.h"
+#include "config.h"
+
+#define _ADDR   0x41
+
+/**
+ * MCLK cycle ceilings per interrupt, with all options built in
+ * Indexed by _SIM_ISR_TIMER_A0 and the rest.
+ */
+static const unsigned long _isr_max[_SIM_ISR_COUNT] = { 80, 50, 50, 96 };
+
+static unsigned int _failed = 0;        // Failed checks in this scenario process
+static unsigned int _runs_failed = 0;   // Scenario processes that failed, counted in main()
+
+extern unsigned long _RES_active;       // Firmware residency counters, ACLK counts
+extern unsigned long _RES_LPM3;
+
+static void _print_uart() {
+    char buf[256];
+    unsigned int n = sim_uart_take(buf, sizeof(buf) - 1);
+    char * line;
+    buf[n] = 0;
+    line = strrchr(buf, '\n');
+    if (line && line != buf) {          // Show the last complete line only
+        *line = 0;
+        line = strrchr(buf, '\n');
+        printf("   UART: %s\n", line ? line + 1 : buf);
+    }
+}
+
+static void _print_i2c(const char * what, sim_i2c_result_t r) {
+    printf("   I2C %-24s %s, %u clocks in %.1f us, stretched %.1f us, effective %.1f kHz\n",
+            what, r.acked ? "ACK " : "NACK", r.bits, r.duration * 1e6, r.stretch * 1e6,
+            r.duration > 0 ? r.bits / r.duration / 1000.0 : 0.0);
+}
+
+/**
+ * Count a failed check, the scenario process exits with 1
+ */
+static void _check(int ok, const char * what) {
+    if (!ok) {
+        printf("   FAIL: %s\n", what);
+        _failed++;
+    }
+}
+
+/**
+ * Interrupt costs since the last sim_stats_reset() against the ceilings
+ */
+static void _check_isr() {
+    const sim_stats_t * st = sim_stats();
+    char what[64];
+    int i;
+    for (i = 0; i < _SIM_ISR_COUNT; i++) {
+        sprintf(what, "%s %lu cycles, ceiling %lu", st->isr[i].name, st->isr[i].cycles_max, _isr_max[i]);
+        _check(st->isr[i].cycles_max <= _isr_max[i], what);
+    }
+}
+
+/**
+ * End a scenario process
+ */
+static void _done() {
+    exit(_failed ? 1 : 0);
+}
+
+/**
+ * Wait for a scenario process and count it when it failed
+ */
+static void _wait(pid_t pid) {
+    int status;
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status))
+        _runs_failed++;
+}
+
+/**
+ * Free running clock, measures ISR cost and wakeups
+ */
+static void _scenario_idle() {
+    static const unsigned long mhz[] = { 1, 16 };
+    unsigned int i;
+    for (i = 0; i < sizeof(mhz) / sizeof(mhz[0]); i++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            printf("== idle, %lu MHz strap\n", mhz[i]);
+            sim_set_mclk_strap(mhz[i]);
+            sim_boot();
+            sim_run(1.0);
+            sim_stats_reset();
+            _RES_active = _RES_LPM3 = 0;
+            sim_run(10.0);
+            sim_report();
+            printf("   Firmware residency: active %lu, LPM3 %lu ACLK counts (%.2f%% asleep)\n",
+                    _RES_active, _RES_LPM3,
+                    100.0 * _RES_LPM3 / (_RES_active + _RES_LPM3 ? _RES_active + _RES_LPM3 : 1));
+            _print_uart();
+            _check(sim_stats()->p1_rise[0] == 10, "1-Hz edges in 10 s");
+            _check_isr();
+            _done();
+        }
+        _wait(pid);
+    }
+}
+
+/**
+ * Burst read of the time registers at different bus rates
+ */
+static void _scenario_i2c() {
+    static const unsigned long mhz[] = { 1, 8, 16 };
+    static const unsigned long rate[] = { 100000, 400000 };
+    static const unsigned char set_time[] = { 0x00, 0x56, 0x34, 0x12, 0x03, 0x15, 0x06, 0x24, 0x20 };
+    unsigned int i, j;
+    unsigned char data[8];
+    char title[64];
+    sim_i2c_result_t r;
+
+    for (i = 0; i < sizeof(mhz) / sizeof(mhz[0]); i++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            printf("== I2C, %lu MHz strap\n", mhz[i]);
+            sim_set_mclk_strap(mhz[i]);
+            sim_boot();
+            sim_run(0.5);
+            sim_stats_reset();
+            for (j = 0; j < sizeof(rate) / sizeof(rate[0]); j++) {
+                sim_set_i2c_rate(rate[j]);
+                r = sim_i2c_write(_ADDR, set_time, sizeof(set_time));
+                sprintf(title, "set time @%lu kHz", rate[j] / 1000);
+                _print_i2c(title, r);
+                _check(r.acked, title);
+                r = sim_i2c_read(_ADDR, 0x00, data, 8);
+                sprintf(title, "read 8 bytes @%lu kHz", rate[j] / 1000);
+                _print_i2c(title, r);
+                _check(r.acked, title);
+                printf("   Time %02X%02X-%02X-%02X %02X:%02X:%02X day %X\n",
+                        data[7], data[6], data[5], data[4], data[2], data[1], data[0], data[3]);
+                _check(!memcmp(data, set_time + 1, 8), "time read back as set");
+            }
+            sim_report();
+            _check_isr();
+            _done();
+        }
+        _wait(pid);
+    }
+}
+
+/**
+ * Effective bus rate per MCLK strap
+ * Alarm registers are written and read back in 16 byte bursts. At the
+ * highest master rate the result is what the slave can sustain, as it
+ * stretches SCL for as long as it needs.
+ */
+static void _scenario_i2c_rate() {
+    static const unsigned long mhz[] = { 1, 8, 12, 16 };
+    static const unsigned long rate[] = { 100000, 400000, 1000000 };
+    unsigned char wr[17], rd[16];
+    unsigned int i, j;
+    sim_i2c_result_t w, r;
+
+    wr[0] = 8;
+    for (i = 1; i < sizeof(wr); i++)
+        wr[i] = i;
+    printf("== I2C bus rate, 16 byte bursts\n");
+    for (i = 0; i < sizeof(mhz) / sizeof(mhz[0]); i++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            sim_set_mclk_strap(mhz[i]);
+            sim_boot();
+            sim_run(0.5);
+            for (j = 0; j < sizeof(rate) / sizeof(rate[0]); j++) {
+                sim_set_i2c_rate(rate[j]);
+                w = sim_i2c_write(_ADDR, wr, sizeof(wr));
+                r = sim_i2c_read(_ADDR, 8, rd, sizeof(rd));
+                printf("   MCLK %2lu MHz, master %4lu kHz: write %5.1f kHz, read %5.1f kHz%s\n",
+                        mhz[i], rate[j] / 1000,
+                        w.bits / w.duration / 1000.0, r.bits / r.duration / 1000.0,
+                        (w.acked && r.acked && !memcmp(wr + 1, rd, sizeof(rd))) ? "" : ", FAILED");
+                _check(w.acked && r.acked && !memcmp(wr + 1, rd, sizeof(rd)), "alarm burst read back");
+            }
+            _done();
+        }
+        _wait(pid);
+    }
+}
+
+/**
+ * CPU speed raised on I2C START up to the strap ceiling and dropped after STOP
+ */
+static void _scenario_clock() {
+    const sim_stats_t * st = sim_stats();
+    unsigned char data[8];
+    sim_i2c_result_t r;
+    double t0;
+    pid_t pid = fork();
+    if (pid == 0) {
+        printf("== CPU speed, 16 MHz ceiling\n");
+        sim_set_mclk_strap(16);
+        sim_boot();
+        sim_run(1.0);
+        sim_stats_reset();
+        sim_run(10.0);
+        printf("   idle 10s: MCLK %lu Hz, %lu DCO changes, %llu active cycles\n",
+                sim_mclk_hz(), st->mclk_changes, st->active_cycles);
+        sim_set_i2c_rate(400000);
+        sim_stats_reset();
+        t0 = sim_time();
+        r = sim_i2c_read(_ADDR, 0x00, data, 8);
+        _print_i2c("read 8 bytes @400 kHz", r);
+        printf("   START to %lu Hz: %.1f us, %lu DCO changes\n",
+                sim_mclk_hz(), (st->mclk_change_t - t0) * 1e6, st->mclk_changes);
+        sim_run(1.0);
+        printf("   1s after STOP: MCLK %lu Hz, %lu DCO changes\n", sim_mclk_hz(), st->mclk_changes);
+        _check(r.acked && st->mclk_changes == 2, "MCLK raised for the transaction and dropped after");
+        _check(sim_mclk_hz() == 1000000, "MCLK back to 1 MHz");
+        _done();
+    }
+    _wait(pid);
+}
+
+/**
+ * Host triggered temperature conversion, single and averaged
+ * The converter in the simulator is 1% high with a 3 LSB offset.
+ */
+static void _scenario_temp() {
+    static const unsigned char convert[] = { 28, 0x40 };
+    static const unsigned char average[] = { 28, 0x48 };   // Same with BIT3, averaged conversion
+    unsigned char data[3], celsius[2];
+    pid_t pid = fork();
+    if (pid == 0) {
+        printf("== temperature conversion at 31.5 C, ideal code 748.7\n");
+        sim_set_temperature(31.5);
+        sim_boot();
+        sim_run(0.5);
+        sim_stats_reset();
+        sim_i2c_write(_ADDR, convert, sizeof(convert));
+        sim_run(1.0);
+        sim_i2c_read(_ADDR, 26, data, 3);
+        sim_i2c_read(_ADDR, 0xEC, celsius, 2);
+        printf("   Single   raw 0x%02X%02X, config 0x%02X, %.2f C\n", data[0], data[1], data[2],
+                (short)((celsius[0] << 8) | celsius[1]) / 256.0);
+        sim_i2c_write(_ADDR, average, sizeof(average));
+        sim_run(1.0);
+        sim_i2c_read(_ADDR, 26, data, 3);
+        sim_i2c_read(_ADDR, 0xEC, celsius, 2);
+        printf("   Averaged 0x%02X%02X = %.2f, config 0x%02X, %.2f C\n", data[0], data[1],
+                ((data[0] << 8) | data[1]) / 64.0, data[2], (short)((celsius[0] << 8) | celsius[1]) / 256.0);
+        _check(fabs((short)((celsius[0] << 8) | celsius[1]) / 256.0 - 31.5) < 0.5, "averaged Celsius within 0.5 C");
+        sim_report();
+        _check_isr();
+        _done();
+    }
+    _wait(pid);
+}
+
+/**
+ * Periodic temperature history, filled for 10 minutes and drained in one burst
+ */
+static void _scenario_history() {
+    static const unsigned char interval[] = { 0x80, 1 };    // One sample a minute
+    unsigned char data[2 + 8 * 4];
+    unsigned int i, n;
+    pid_t pid = fork();
+    if (pid == 0) {
+        printf("== temperature history, 1 minute interval\n");
+        sim_boot();
+        sim_run(0.5);
+        sim_i2c_write(_ADDR, interval, sizeof(interval));
+        sim_stats_reset();
+        for (i = 0; i < 10; i++) {
+            sim_set_temperature(20.0 + i);
+            sim_run(60.0);
+        }
+        sim_i2c_read(_ADDR, 0x81, data, 1);
+        n = data[0];
+        sim_i2c_read(_ADDR, 0x81, data, 1 + n * 4);
+        printf("   %u entries\n", data[0]);
+        for (i = 0; i < n; i++)
+            printf("   minute %5u  %.2f\n", (data[1 + i * 4] << 8) | data[2 + i * 4],
+                    ((data[3 + i * 4] << 8) | data[4 + i * 4]) / 64.0);
+        sim_i2c_read(_ADDR, 0x81, data, 1);
+        printf("   %u entries after the drain\n", data[0]);
+#ifdef _TEMP_HISTORY
+        _check(n == _TEMP_HISTORY, "history full after 10 minutes");
+#endif
+        _check(data[0] == 0, "history drained");
+        sim_report();
+        _check_isr();
+        _done();
+    }
+    _wait(pid);
+}
+
+/**
+ * Event log: power up, time set and an alarm, streamed in one burst
+ */
+static void _scenario_log() {
+    static const unsigned char set_time[] = { 0x00, 0x56, 0x34, 0x12, 0x05, 0x15, 0x03, 0x24, 0x20 };
+    static const unsigned char alarm1[] = { 8, 0x35, 0x92, 0x10 };    // 12:35 on Friday, enabled
+    static const unsigned char enable[] = { 29, 0x01 };
+    unsigned char data[2 + 8 * 4];
+    unsigned int i, n;
+    pid_t pid = fork();
+    if (pid == 0) {
+        printf("== event log\n");
+        sim_boot();
+        sim_run(0.5);
+        sim_i2c_write(_ADDR, set_time, sizeof(set_time));
+        sim_i2c_write(_ADDR, alarm1, sizeof(alarm1));
+        sim_i2c_write(_ADDR, enable, sizeof(enable));
+        sim_run(10.0);
+        sim_i2c_read(_ADDR, 0x78, data, 1);
+        n = data[0];
+        sim_i2c_read(_ADDR, 0x78, data, 2 + n * 4);
+        printf("   %u records, %u lost\n", data[0], data[1]);
+        for (i = 0; i < n; i++)
+            printf("   code 0x%02X at %lu\n", data[2 + i * 4],
+                    ((unsigned long)data[3 + i * 4] << 16) | (data[4 + i * 4] << 8) | data[5 + i * 4]);
+#ifdef _EVENT_LOG
+        _check(n == 3 && data[1] == 0 && data[2] == 0x01 && data[6] == 0x02 && data[10] == 0x20,
+                "power up, time set and alarm logged");
+#endif
+        sim_i2c_read(_ADDR, 0x78, data, 3);
+        printf("   %u records after the burst, stream 0x%02X\n", data[0], data[2]);
+        _check(data[0] == 0, "log drained");
+        _done();
+    }
+    _wait(pid);
+}
+
+/**
+ * Clock error in ppm over some simulated time, from the 1-Hz output edges
+ * Positive when the clock runs fast.
+ */
+static double _clock_ppm(double seconds) {
+    const sim_stats_t * st = sim_stats();
+    unsigned long n0;
+    double t0;
+    sim_run(1.0);                       // Start on a fresh edge
+    n0 = st->p1_rise[0];
+    t0 = st->p1_rise_t[0];
+    sim_run(seconds);
+    return (1.0 - (st->p1_rise_t[0] - t0) / (st->p1_rise[0] - n0)) * 1e6;
+}
+
+/**
+ * Crystal 10ppm fast, trimmed with the aging offset
+ */
+static void _scenario_trim() {
+    static const unsigned char aging[] = { 0x7B, 84 };     // 84 / 256 count per second, 10.0ppm
+    double ppm;
+    pid_t pid = fork();
+    if (pid == 0) {
+        printf("== aging offset, crystal +10ppm\n");
+        sim_set_crystal_ppm(10.0);
+        sim_boot();
+        sim_run(0.75);
+        printf("   Untrimmed: %+.3f ppm\n", _clock_ppm(1000.0));
+        sim_i2c_write(_ADDR, aging, sizeof(aging));
+        sim_stats_reset();
+        ppm = _clock_ppm(1000.0);
+        printf("   Aging %d: %+.3f ppm\n", aging[1], ppm);
+#ifdef _TRIM
+        _check(fabs(ppm) < 0.1, "trimmed within 0.1 ppm");
+#endif
+        sim_report();
+        _check_isr();
+        _done();
+    }
+    _wait(pid);
+}
+
+/**
+ * Crystal away from its turnover temperature, compensated once a minute
+ */
+static void _scenario_tcomp() {
+    static const unsigned char off[] = { 0x7D, 0 };
+    static const unsigned char on[] = { 0x7D, 34 };         // 0.034ppm/C^2, as the crystal
+    static const double temps[] = { -10.0, 60.0, 25.0 };
+    double ppm;
+    unsigned int i;
+    pid_t pid = fork();
+    if (pid == 0) {
+        printf("== temperature compensation, crystal -0.034ppm/C^2\n");
+        sim_set_temperature(temps[0]);
+        sim_boot();
+        sim_run(0.75);
+        sim_i2c_write(_ADDR, off, sizeof(off));
+        sim_run(1.0);
+        printf("   %5.1f C off: %+.3f ppm\n", temps[0], _clock_ppm(600.0));
+        sim_i2c_write(_ADDR, on, sizeof(on));
+        sim_stats_reset();
+        for (i = 0; i < sizeof(temps) / sizeof(temps[0]); i++) {
+            sim_set_temperature(temps[i]);
+            sim_run(61.0);              // Next compensation sample
+            ppm = _clock_ppm(600.0);
+            printf("   %5.1f C on:  %+.3f ppm\n", temps[i], ppm);
+#ifdef _TEMP_COMP
+            _check(fabs(ppm) < 1.0, "compensated within 1 ppm");
+#endif
+        }
+        sim_report();
+        _check_isr();
+        _done();
+    }
+    _wait(pid);
+}
+
+/**
+ * Sub-second registers and P1.2 edge capture against the simulated time
+ * The capture part needs a build with -D_CAPTURE=4.
+ */
+static void _scenario_subsec() {
+    const sim_stats_t * st = sim_stats();
+    unsigned char data[2 + 4 * 4];
+    unsigned long n;
+    double t0, t;
+    unsigned int i;
+    pid_t pid = fork();
+    if (pid == 0) {
+        printf("== sub-second registers\n");
+        sim_boot();
+        sim_run(5.3);
+        for (i = 0; i < 3; i++) {
+            n = st->p1_rise[0];             // The clock counts seconds from the first 1-Hz edge
+            t0 = st->p1_rise_t[0];
+            t = sim_time();
+            sim_i2c_read(_ADDR, 0, data, 1);
+            sim_i2c_read(_ADDR, 0x7E, data + 1, 2);
+            printf("   read at %lu+%.6f s: second %02X, fraction %.6f s\n", n, t - t0,
+                    data[0], ((data[1] << 8) | data[2]) / 32768.0);
+            _check(fabs(((data[1] << 8) | data[2]) / 32768.0 - (t - t0)) < 0.001, "fraction within 1 ms");
+            sim_run(0.37);
+        }
+#ifdef _CAPTURE
+        {
+            static const double at[] = { 0.2501, 0.7, 0.99999, 1.00009 };
+            static const unsigned char rising[] = { 0x73, 1 };
+            sim_p1_input(0x04, 0);
+            sim_i2c_write(_ADDR, rising, sizeof(rising));
+            sim_run(1.0 - (sim_time() - st->p1_rise_t[0]));     // Next second boundary
+            n = st->p1_rise[0];
+            t0 = st->p1_rise_t[0];
+            printf("   P1.2 rising edges, times from the 1-Hz edge, which is ~50us late\n");
+            for (i = 0; i < sizeof(at) / sizeof(at[0]); i++) {
+                sim_run(t0 + at[i] - sim_time());
+                sim_p1_input(0x04, 1);
+                sim_run(0.00001);
+                sim_p1_input(0x04, 0);
+            }
+            sim_i2c_read(_ADDR, 0x70, data, 2);
+            printf("   %u entries, %u lost\n", data[0], data[1]);
+            sim_i2c_read(_ADDR, 0x72, data, 4 * 4);
+            for (i = 0; i < sizeof(at) / sizeof(at[0]); i++)
+                printf("   edge at %lu+%.6f s: %u+%.6f s\n", n, at[i], (data[i * 4] << 8) | data[i * 4 + 1],
+                        ((data[i * 4 + 2] << 8) | data[i * 4 + 3]) / 32768.0);
+        }
+#endif
+        _done();
+    }
+    _wait(pid);
+}
+
+/**
+ * Unix time window against the BCD registers, both ways
+ * The reference dates come from the host C library.
+ */
+static void _scenario_unix() {
+    static const unsigned long times[] = {
+        946684800UL,    // 2000-01-01 00:00:00
+        951868799UL,    // 2000-02-29 23:59:59
+        1700000000UL,   // 2023-11-14 22:13:20
+        1735689599UL,   // 2024-12-31 23:59:59
+        4107542399UL,   // 2100-02-28 23:59:59
+        4107542400UL,   // 2100-03-01 00:00:00
+        4294967295UL,   // 2106-02-07 06:28:15
+    };
+    unsigned char w[9], r[8], u[4];
+    unsigned long back;
+    unsigned int i, j, bad = 0;
+    time_t t;
+    struct tm tm;
+    pid_t pid = fork();
+    if (pid == 0) {
+        printf("== Unix time window\n");
+        sim_boot();
+        sim_run(0.5);
+        for (i = 0; i < sizeof(times) / sizeof(times[0]); i++) {
+            t = (time_t)times[i];
+            gmtime_r(&t, &tm);
+            // Unix write, BCD and Unix read back
+            w[0] = 0x74;
+            for (j = 0; j < 4; j++)
+                w[1 + j] = times[i] >> (j * 8);
+            sim_i2c_write(_ADDR, w, 5);
+            sim_run(0.01);
+            sim_i2c_read(_ADDR, 0, r, 8);
+            sim_i2c_read(_ADDR, 0x74, u, 4);
+            back = u[0] | (u[1] << 8) | ((unsigned long)u[2] << 16) | ((unsigned long)u[3] << 24);
+            printf("   %10lu -> %02X%02X-%02X-%02X %02X:%02X:%02X day %X -> %10lu\n", times[i],
+                    r[7], r[6], r[5], r[4], r[2], r[1], r[0], r[3], back);
+            if (r[0] != (tm.tm_sec / 10 << 4 | tm.tm_sec % 10) || r[4] != (tm.tm_mday / 10 << 4 | tm.tm_mday % 10)
+                    || r[3] != (tm.tm_wday ? tm.tm_wday : 7) || back != times[i])
+                bad++;
+            // BCD write of the same time, Unix read back
+            w[0] = 0;
+            w[1] = tm.tm_sec / 10 << 4 | tm.tm_sec % 10;
+            w[2] = tm.tm_min / 10 << 4 | tm.tm_min % 10;
+            w[3] = tm.tm_hour / 10 << 4 | tm.tm_hour % 10;
+            w[4] = tm.tm_wday ? tm.tm_wday : 7;
+            w[5] = tm.tm_mday / 10 << 4 | tm.tm_mday % 10;
+            w[6] = (tm.tm_mon + 1) / 10 << 4 | (tm.tm_mon + 1) % 10;
+            w[7] = (tm.tm_year % 100) / 10 << 4 | tm.tm_year % 10;
+            w[8] = tm.tm_year >= 200 ? 0x21 : 0x20;
+            sim_i2c_write(_ADDR, w, 9);
+            sim_run(0.01);
+            sim_i2c_read(_ADDR, 0x74, u, 4);
+            back = u[0] | (u[1] << 8) | ((unsigned long)u[2] << 16) | ((unsigned long)u[3] << 24);
+            if (back != times[i])
+                bad++;
+        }
+        printf("   %u mismatches\n", bad);
+        w[0] = 0x74;                        // New year's eve, then let it tick over
+        for (j = 0; j < 4; j++)
+            w[1 + j] = times[3] >> (j * 8);
+        sim_i2c_write(_ADDR, w, 5);
+        sim_run(1.5);
+        sim_i2c_read(_ADDR, 0, r, 8);
+        printf("   %lu + 1s -> %02X%02X-%02X-%02X %02X:%02X:%02X day %X\n", times[3],
+                r[7], r[6], r[5], r[4], r[2], r[1], r[0], r[3]);
+        _check(bad == 0, "Unix and BCD views agree");
+        _check(!memcmp(r, "\x00\x00\x00\x03\x01\x01\x25\x20", 8), "new year rolled over");
+        _done();
+    }
+    _wait(pid);
+}
+
+/**
+ * P1.0 square wave settings, edges and Timer_A0 interrupts for each
+ */
+static void _scenario_sqw() {
+    static const unsigned char mode[] = { 0, 1, 2 };
+    static const char * const name[] = { "1 Hz", "32768 Hz", "off" };
+    static const unsigned long edges[] = { 10, 0, 0 };
+    static const unsigned long aclk[] = { 0, 32768, 0 };
+    const sim_stats_t * st = sim_stats();
+    unsigned char set[2] = { 28, 0 };
+    unsigned int i;
+    pid_t pid = fork();
+    if (pid == 0) {
+        printf("== square wave on P1.0\n");
+        sim_boot();
+        sim_run(0.5);
+        for (i = 0; i < sizeof(mode); i++) {
+            set[1] = mode[i];
+            sim_i2c_write(_ADDR, set, sizeof(set));
+            sim_run(1.0);
+            sim_stats_reset();
+            sim_run(10.0);
+            printf("   %-8s: %lu edges, ACLK %lu Hz, Timer_A0 %.1f/s\n", name[i],
+                    st->p1_rise[0], sim_p1_0_hz(), st->isr[_SIM_ISR_TIMER_A0].calls / 10.0);
+            _check(st->p1_rise[0] == edges[i] && sim_p1_0_hz() == aclk[i], name[i]);
+        }
+        set[1] = 0;                         // And back
+        sim_i2c_write(_ADDR, set, sizeof(set));
+        sim_run(1.0);
+        sim_stats_reset();
+        sim_run(10.0);
+        printf("   %-8s: %lu edges, ACLK %lu Hz, Timer_A0 %.1f/s\n", name[0],
+                st->p1_rise[0], sim_p1_0_hz(), st->isr[_SIM_ISR_TIMER_A0].calls / 10.0);
+        _check(st->p1_rise[0] == edges[0], "1 Hz again");
+        _done();
+    }
+    _wait(pid);
+}
+
+/**
+ * Register pages: bounds at the end of a page, a whole window in one burst, wrap
+ */
+static void _scenario_pages() {
+    static const unsigned char alarms[] = { 0xFF, 1 };
+    static const unsigned char history[] = { 0xFF, 6 };
+    static const unsigned char wrap[] = { 0xFF, 0x86 };
+    static const unsigned char flat[] = { 0xFF, 0 };
+    static const unsigned char past[] = { 33, 0x11, 0x22, 0x33, 0x44 };  // Last alarm byte and beyond
+    unsigned char data[24];
+    unsigned int i, n;
+    sim_i2c_result_t r;
+    pid_t pid = fork();
+    if (pid == 0) {
+        printf("== register pages\n");
+        sim_boot();
+        sim_run(0.5);
+        sim_i2c_read(_ADDR, 40, data, 6);
+        printf("   page 0 at 40:    ");
+        for (i = 0; i < 6; i++)
+            printf(" %02X", data[i]);
+        printf("\n");
+        sim_i2c_write(_ADDR, alarms, sizeof(alarms));
+        r = sim_i2c_write(_ADDR, past, sizeof(past));
+        _print_i2c("write past page 1", r);
+        _check(!r.acked, "write past page 1 NACKed");
+        sim_i2c_read(_ADDR, 32, data, 4);
+        printf("   page 1 at 32:    ");
+        for (i = 0; i < 4; i++)
+            printf(" %02X", data[i]);
+        printf("\n");
+        _check(data[1] == 0x11 && data[2] == 0x22 && data[3] == 0xFF, "page 1 end, padding after it");
+#ifdef _TEMP_HISTORY
+        n = 2 + 4 * _TEMP_HISTORY;
+        sim_i2c_write(_ADDR, history, sizeof(history));
+        sim_i2c_read(_ADDR, 0, data, n + 2);
+        printf("   page 6 at 0:     ");
+        for (i = 0; i < n + 2; i++)
+            printf(" %02X", data[i]);
+        printf("\n");
+        sim_i2c_read(_ADDR, 0xFF, data, 1);
+        printf("   bank select:      %02X\n", data[0]);
+        sim_i2c_write(_ADDR, wrap, sizeof(wrap));
+        sim_i2c_read(_ADDR, n - 2, data, 6);
+        printf("   page 6 wrapping: ");
+        for (i = 0; i < 6; i++)
+            printf(" %02X", data[i]);
+        printf("\n");
+#else
+        (void)history;
+        (void)wrap;
+        (void)n;
+#endif
+        sim_i2c_read(_ADDR, 0xFF, data, 1);
+        printf("   bank select:      %02X\n", data[0]);
+        sim_i2c_write(_ADDR, flat, sizeof(flat));
+        _done();
+    }
+    _wait(pid);
+}
+
+#ifdef _TEMP_ALARM
+/**
+ * High threshold at 35 C with 2 C hysteresis, the temperature moved
+ * around it a minute at a time
+ */
+static void _scenario_talarm() {
+    static const double celsius[] = { 31.5, 36.0, 36.0, 34.0, 32.5, 36.0 };
+    static const unsigned char raised[] = { 0, 1, 0, 0, 0, 1 };    // Flag cleared after each step
+    static const unsigned char thresholds[] = { 0xEE, 35, 0x80, 2 };
+    static const unsigned char enable[] = { 33, 0x40 };
+    static const unsigned char clear[] = { 36, 0x00 };
+    const sim_stats_t * st = sim_stats();
+    unsigned char data[3];
+    unsigned int i;
+    pid_t pid = fork();
+    if (pid == 0) {
+        printf("== temperature thresholds\n");
+        sim_boot();
+        sim_run(0.5);
+        sim_i2c_write(_ADDR, thresholds, sizeof(thresholds));
+        sim_i2c_write(_ADDR, enable, sizeof(enable));
+        for (i = 0; i < sizeof(celsius) / sizeof(celsius[0]); i++) {
+            sim_set_temperature(celsius[i]);
+            sim_run(60.0);                  // Sampled at the minute
+            sim_stats_reset();
+            sim_run(5.0);
+            sim_i2c_read(_ADDR, 36, data, 1);
+            sim_i2c_read(_ADDR, 0xEC, data + 1, 2);
+            printf("   %4.1f C: read %6.2f C, flags 0x%02X, P1.5 %lu pulses in 5 s\n", celsius[i],
+                    (short)((data[1] << 8) | data[2]) / 256.0, data[0], st->p1_rise[5]);
+            _check((data[0] == 0x40) == raised[i] && (st->p1_rise[5] != 0) == raised[i], "threshold flag and pulses");
+            sim_i2c_write(_ADDR, clear, sizeof(clear));
+        }
+        _done();
+    }
+    _wait(pid);
+}
+#endif
+
+#ifdef _TIMERS
+/**
+ * A periodic timer on P1.5 and a countdown on P1.4, then a time set under them
+ */
+static void _scenario_timers() {
+    static const unsigned char start[] = { 0x64, 3, 0, 0xC1, 10, 0, 0x82 };    // 3s periodic, 10s countdown
+    static const unsigned char clear[] = { 0x66, 0xC1 };                       // Also keeps it running
+    static const unsigned char restart[] = { 0x69, 0x82 };
+    static const unsigned char set_time[] = { 0x00, 0x00, 0x00, 0x00, 0x01, 0x01, 0x01, 0x24, 0x20 };
+    const sim_stats_t * st = sim_stats();
+    unsigned char data[6];
+    double t0;
+    pid_t pid = fork();
+    if (pid == 0) {
+        printf("== timers\n");
+        sim_boot();
+        sim_run(0.5);
+        sim_stats_reset();
+        sim_i2c_write(_ADDR, start, sizeof(start));
+        t0 = sim_time();
+        sim_run(3.2);
+        printf("   after 3s: P1.5 %lu at +%.3f s, P1.4 %lu\n", st->p1_rise[5],
+                st->p1_rise_t[5] - t0, st->p1_rise[4]);
+        sim_i2c_write(_ADDR, clear, sizeof(clear));
+        sim_run(7.0);
+        sim_i2c_read(_ADDR, 0x64, data, 6);
+        printf("   after 10s: P1.5 %lu, P1.4 %lu at +%.3f s, control %02X %02X\n", st->p1_rise[5],
+                st->p1_rise[4], st->p1_rise_t[4] - t0, data[2], data[5]);
+        _check(st->p1_rise[5] == 6 && st->p1_rise[4] == 1, "periodic and countdown pulses");
+        sim_i2c_write(_ADDR, clear, sizeof(clear));
+        sim_i2c_write(_ADDR, restart, sizeof(restart));     // Clear and restart the countdown
+        sim_i2c_write(_ADDR, set_time, sizeof(set_time));
+        sim_stats_reset();
+        t0 = sim_time();
+        sim_run(10.2);
+        sim_i2c_read(_ADDR, 0x64, data, 6);
+        printf("   time set, 10s later: P1.4 %lu at +%.3f s, control %02X %02X\n",
+                st->p1_rise[4], st->p1_rise_t[4] - t0, data[2], data[5]);
+        _check(st->p1_rise[4] == 1, "countdown fires once across a time set");
+        _done();
+    }
+    _wait(pid);
+}
+#endif
+
+#ifdef _DIAG
+/**
+ * Diagnostics window against the simulator's own accounting
+ * Times read back in ACLK counts, shown in us.
+ */
+static void _scenario_diag() {
+    static const char * const isr[] = { "Timer_A0", "USI_INT", "ADC10_ISR", "Timer_A1" };
+    static const unsigned char clear[] = { 0xC0, 0 };
+    static const unsigned char convert[] = { 28, 0x40 };
+    unsigned char data[44], time[8];
+    unsigned long calls, ticks, active, sleep;
+    unsigned int i;
+    pid_t pid = fork();
+    if (pid == 0) {
+        printf("== diagnostics window\n");
+        sim_boot();
+        sim_run(1.0);
+        sim_i2c_write(_ADDR, clear, sizeof(clear));
+        sim_stats_reset();
+        for (i = 0; i < 10; i++) {
+            sim_i2c_read(_ADDR, 0, time, sizeof(time));
+            if (i == 5)
+                sim_i2c_write(_ADDR, convert, sizeof(convert));
+            sim_run(1.0);
+        }
+        sim_report();
+        _check_isr();
+        sim_i2c_read(_ADDR, 0xC0, data, sizeof(data));
+        for (i = 0; i < 4; i++) {
+            calls = data[i * 5] | (data[i * 5 + 1] << 8);
+            ticks = data[i * 5 + 2] | (data[i * 5 + 3] << 8);
+            if (calls && data[i * 5 + 4] != 0xFF)  // Not timed or not built in
+                printf("   %-10s %5lu calls, avg %6.1f us, max %6.1f us\n", isr[i], calls,
+                        ticks * 1e6 / 32768 / calls, data[i * 5 + 4] * 1e6 / 32768);
+        }
+        for (i = 0; i < 16; i++)
+            if (data[20 + i])
+                printf("   action bit%s %u served within %6.1f us of the wake up\n",
+                        i < 8 ? " " : "2", i & 7, data[20 + i] * 1e6 / 32768);
+        active = data[36] | (data[37] << 8) | ((unsigned long)data[38] << 16) | ((unsigned long)data[39] << 24);
+        sleep = data[40] | (data[41] << 8) | ((unsigned long)data[42] << 16) | ((unsigned long)data[43] << 24);
+        printf("   active %lu, LPM3 %lu ACLK counts, %.3f%% asleep\n", active, sleep,
+                100.0 * sleep / (active + sleep ? active + sleep : 1));
+        _check(fabs(active + sleep - 32768 * 10.0) < 32768 * 0.1 && active < sleep, "residency covers the 10 s");
+        _done();
+    }
+    _wait(pid);
+}
+#endif
+
+/**
+ * Alarm and configuration writes saved to flash and restored after a reset
+ * Each boot runs in its own process, the flash contents are handed over
+ * through a pipe.
+ */
+static void _scenario_persist() {
+    static const unsigned char alarm1[] = { 8, 0x35, 0x92, 0x10 };
+    static const unsigned char enable[] = { 29, 0x01 };
+    static const unsigned char config[] = { 28, 0x88 };    // Dedicated outputs, averaged conversion
+    static const unsigned char interval[] = { 0x80, 15 };
+    static const unsigned char aging[] = { 0x7B, 0xF0 };   // -16
+    unsigned char info[192], data[26];
+    unsigned int i, j;
+    int fd[2];
+    pid_t pid;
+
+    printf("== persistence\n");
+    if (pipe(fd)) {
+        _runs_failed++;
+        return;
+    }
+    pid = fork();
+    if (pid == 0) {
+        sim_boot();
+        sim_run(0.5);
+        sim_i2c_write(_ADDR, alarm1, sizeof(alarm1));
+        sim_i2c_write(_ADDR, enable, sizeof(enable));
+        sim_i2c_write(_ADDR, config, sizeof(config));
+        sim_i2c_write(_ADDR, interval, sizeof(interval));
+        sim_i2c_write(_ADDR, aging, sizeof(aging));
+        sim_run(2.0);
+        printf("   First boot: %lu erases, %lu bytes after the first burst\n",
+                sim_flash_erases(), sim_flash_bytes());
+        for (i = 0; i < 40; i++) {      // Alarm changes, one save each
+            unsigned char w[] = { 10, (unsigned char)(i & 0x7F) };
+            sim_i2c_write(_ADDR, w, sizeof(w));
+            sim_run(1.5);
+        }
+        sim_i2c_write(_ADDR, alarm1, sizeof(alarm1));
+        sim_run(1.5);
+        printf("   40 more saves: %lu erases, %lu bytes\n", sim_flash_erases(), sim_flash_bytes());
+        sim_info_save(info);
+        if (write(fd[1], info, sizeof(info)) != sizeof(info))
+            exit(1);
+        _done();
+    }
+    _wait(pid);
+    if (read(fd[0], info, sizeof(info)) != sizeof(info)) {
+        _runs_failed++;
+        return;
+    }
+    close(fd[0]);
+    close(fd[1]);
+    pid = fork();
+    if (pid == 0) {
+        sim_info_load(info);
+        sim_boot();
+        sim_run(0.5);
+        sim_i2c_read(_ADDR, 8, data, 22);
+        printf("   After reset: alarm1 %02X %02X %02X, config 0x%02X, enables 0x%02X",
+                data[0], data[1], data[2], data[20], data[21]);
+        sim_i2c_read(_ADDR, 0x80, data + 22, 1);
+        printf(", interval %u", data[22]);
+        sim_i2c_read(_ADDR, 0x7B, data + 23, 1);
+        printf(", aging %d\n", (signed char)data[23]);
+        for (j = 0; j < 3; j++) {
+            printf("   Segment %c:", "DCB"[j]);
+            for (i = 0; i < 8; i++)
+                printf(" %02X", info[j * 64 + i]);
+            printf(" ...\n");
+        }
+#ifdef _PERSIST
+        _check(!memcmp(data, alarm1 + 1, 3) && data[20] == config[1] && data[21] == enable[1],
+                "alarm and configuration restored after reset");
+#ifdef _TEMP_HISTORY
+        _check(data[22] == interval[1], "history interval restored after reset");
+#endif
+#ifdef _TRIM
+        _check(data[23] == aging[1], "aging offset restored after reset");
+#endif
+#endif
+        _done();
+    }
+    _wait(pid);
+    pid = fork();
+    if (pid == 0) {
+        for (j = 0; j < 3; j++)
+            info[j * 64 + 2]++;             // Saved by a build with one more register
+        sim_info_load(info);
+        sim_boot();
+        sim_run(0.5);
+        sim_i2c_read(_ADDR, 8, data, 22);
+        printf("   Other layout: alarm1 %02X %02X %02X, config 0x%02X, enables 0x%02X, %lu erases\n",
+                data[0], data[1], data[2], data[20], data[21], sim_flash_erases());
+        _check(!data[0] && !data[1] && !data[2] && !data[20] && !data[21], "other layout starts from defaults");
+        _done();
+    }
+    _wait(pid);
+}
+
+typedef struct {
+    const char * name;
+    void (*run)();
+} scenario_t;
+
+static const scenario_t _scenarios[] = {
+    { "idle", _scenario_idle },
+    { "i2c", _scenario_i2c },
+    { "i2c_rate", _scenario_i2c_rate },
+    { "clock", _scenario_clock },
+    { "temp", _scenario_temp },
+    { "history", _scenario_history },
+    { "log", _scenario_log },
+    { "persist", _scenario_persist },
+    { "trim", _scenario_trim },
+    { "tcomp", _scenario_tcomp },
+    { "subsec", _scenario_subsec },
+    { "unix", _scenario_unix },
+    { "sqw", _scenario_sqw },
+    { "pages", _scenario_pages },
+#ifdef _TEMP_ALARM
+    { "talarm", _scenario_talarm },
+#endif
+#ifdef _TIMERS
+    { "timers", _scenario_timers },
+#endif
+#ifdef _DIAG
+    { "diag", _scenario_diag },
+#endif
+};
+
+int main(int argc, char ** argv) {
+    unsigned int i;
+    int a;
+    setvbuf(stdout, 0, _IONBF, 0);
+    for (i = 0; i < sizeof(_scenarios) / sizeof(_scenarios[0]); i++) {
+        if (argc > 1) {
+            for (a = 1; a < argc; a++)
+                if (!strcmp(argv[a], _scenarios[i].name))
+                    break;
+            if (a == argc)
+                continue;
+        }
+        _scenarios[i].run();
+    }
+    if (_runs_failed)
+        printf("%u scenario runs failed\n", _runs_failed);
+    return _runs_failed ? 1 : 0;
+}
@@ -0,0 +1,361 @@
+/*
+ * Host replacement of <msp430.h> for the simulator
+ *
+ * HouYu Li <karajan_ii@hotmail.com>
+ *
+ * No license applied. Use as you wish.
+ *
+ * Only the registers and bit names used by this firmware are provided.
+ * 16-bit registers are held in unsigned short as int is wider on host.
+ * Every register access goes through _sim_r8() / _sim_r16(), which
+ * charges the access to the virtual CPU clock and lets the simulated
+ * peripherals react to what the firmware wrote.
+ */
+
+#ifndef MSP430_HOST_H_
+#define MSP430_HOST_H_
+
+/**
+ * Register list: X(name)
+ */
+#define _SIM_REGS8(X) \
+    X(IE1) X(IFG1) \
+    X(DCOCTL) X(BCSCTL1) X(BCSCTL2) X(BCSCTL3) \
+    X(P1IN) X(P1OUT) X(P1DIR) X(P1IFG) X(P1IES) X(P1IE) X(P1SEL) X(P1SEL2) X(P1REN) \
+    X(P2IN) X(P2OUT) X(P2DIR) X(P2IFG) X(P2IES) X(P2IE) X(P2SEL) X(P2SEL2) X(P2REN) \
+    X(USICTL0) X(USICTL1) X(USICKCTL) X(USICNT) X(USISRL) X(USISRH) \
+    X(ADC10DTC0) X(ADC10DTC1) X(ADC10AE0)
+
+#define _SIM_REGS16(X) \
+    X(WDTCTL) \
+    X(TACTL) X(TAR) X(TACCTL0) X(TACCTL1) X(TACCTL2) X(TACCR0) X(TACCR1) X(TACCR2) \
+    X(ADC10CTL0) X(ADC10CTL1) X(ADC10MEM) X(ADC10SA) \
+    X(FCTL1) X(FCTL2) X(FCTL3)
+
+#define _SIM_DECLARE8(name)     extern volatile unsigned char _sim_##name;
+#define _SIM_DECLARE16(name)    extern volatile unsigned short _sim_##name;
+_SIM_REGS8(_SIM_DECLARE8)
+_SIM_REGS16(_SIM_DECLARE16)
+#undef _SIM_DECLARE8
+#undef _SIM_DECLARE16
+
+volatile unsigned char * _sim_r8(volatile unsigned char * reg);
+volatile unsigned short * _sim_r16(volatile unsigned short * reg);
+volatile unsigned short * _sim_taiv();
+
+#define IE1         (*_sim_r8(&_sim_IE1))
+#define IFG1        (*_sim_r8(&_sim_IFG1))
+#define DCOCTL      (*_sim_r8(&_sim_DCOCTL))
+#define BCSCTL1     (*_sim_r8(&_sim_BCSCTL1))
+#define BCSCTL2     (*_sim_r8(&_sim_BCSCTL2))
+#define BCSCTL3     (*_sim_r8(&_sim_BCSCTL3))
+#define P1IN        (*_sim_r8(&_sim_P1IN))
+#define P1OUT       (*_sim_r8(&_sim_P1OUT))
+#define P1DIR       (*_sim_r8(&_sim_P1DIR))
+#define P1IFG       (*_sim_r8(&_sim_P1IFG))
+#define P1IES       (*_sim_r8(&_sim_P1IES))
+#define P1IE        (*_sim_r8(&_sim_P1IE))
+#define P1SEL       (*_sim_r8(&_sim_P1SEL))
+#define P1SEL2      (*_sim_r8(&_sim_P1SEL2))
+#define P1REN       (*_sim_r8(&_sim_P1REN))
+#define P2IN        (*_sim_r8(&_sim_P2IN))
+#define P2OUT       (*_sim_r8(&_sim_P2OUT))
+#define P2DIR       (*_sim_r8(&_sim_P2DIR))
+#define P2IFG       (*_sim_r8(&_sim_P2IFG))
+#define P2IES       (*_sim_r8(&_sim_P2IES))
+#define P2IE        (*_sim_r8(&_sim_P2IE))
+#define P2SEL       (*_sim_r8(&_sim_P2SEL))
+#define P2SEL2      (*_sim_r8(&_sim_P2SEL2))
+#define P2REN       (*_sim_r8(&_sim_P2REN))
+#define USICTL0     (*_sim_r8(&_sim_USICTL0))
+#define USICTL1     (*_sim_r8(&_sim_USICTL1))
+#define USICKCTL    (*_sim_r8(&_sim_USICKCTL))
+#define USICNT      (*_sim_r8(&_sim_USICNT))
+#define USISRL      (*_sim_r8(&_sim_USISRL))
+#define USISRH      (*_sim_r8(&_sim_USISRH))
+#define ADC10DTC0   (*_sim_r8(&_sim_ADC10DTC0))
+#define ADC10DTC1   (*_sim_r8(&_sim_ADC10DTC1))
+#define ADC10AE0    (*_sim_r8(&_sim_ADC10AE0))
+#define WDTCTL      (*_sim_r16(&_sim_WDTCTL))
+#define TACTL       (*_sim_r16(&_sim_TACTL))
+#define TAR         (*_sim_r16(&_sim_TAR))
+#define TACCTL0     (*_sim_r16(&_sim_TACCTL0))
+#define TACCTL1     (*_sim_r16(&_sim_TACCTL1))
+#define TACCTL2     (*_sim_r16(&_sim_TACCTL2))
+#define TACCR0      (*_sim_r16(&_sim_TACCR0))
+#define TACCR1      (*_sim_r16(&_sim_TACCR1))
+#define TACCR2      (*_sim_r16(&_sim_TACCR2))
+#define TAIV        (*_sim_taiv())
+#define ADC10CTL0   (*_sim_r16(&_sim_ADC10CTL0))
+#define ADC10CTL1   (*_sim_r16(&_sim_ADC10CTL1))
+#define ADC10MEM    (*_sim_r16(&_sim_ADC10MEM))
+#define ADC10SA     (*_sim_r16(&_sim_ADC10SA))
+#define FCTL1       (*_sim_r16(&_sim_FCTL1))
+#define FCTL2       (*_sim_r16(&_sim_FCTL2))
+#define FCTL3       (*_sim_r16(&_sim_FCTL3))
+
+/**
+ * DCO calibration constants
+ * Arbitrary but distinct values so the simulator can tell them apart
+ */
+#define CALBC1_1MHZ     0x86
+#define CALDCO_1MHZ     0xB5
+#define CALBC1_8MHZ     0x8D
+#define CALDCO_8MHZ     0x92
+#define CALBC1_12MHZ    0x8E
+#define CALDCO_12MHZ    0x9E
+#define CALBC1_16MHZ    0x8F
+#define CALDCO_16MHZ    0x95
+
+/**
+ * TLV calibration data of the ADC10
+ * Read from flash on target, no register cost
+ */
+extern unsigned char _sim_TLV_ADC10_1_TAG;
+extern const unsigned short _sim_TLV_ADC10[8];
+
+#define TLV_ADC10_1_TAG         _sim_TLV_ADC10_1_TAG
+#define TAG_ADC10_1             0x10
+#define CAL_ADC_GAIN_FACTOR     0x0000
+#define CAL_ADC_OFFSET          0x0001
+#define CAL_ADC_15VREF_FACTOR   0x0002
+#define CAL_ADC_15T30           0x0003
+#define CAL_ADC_15T85           0x0004
+#define CAL_ADC_25VREF_FACTOR   0x0005
+#define CAL_ADC_25T30           0x0006
+#define CAL_ADC_25T85           0x0007
+
+/**
+ * Information flash segments D, C and B
+ * Writes land in the array and are checked against FCTL at the next
+ * register access.
+ */
+extern unsigned char _sim_info[192];
+
+/**
+ * 16-bit bus address of a RAM object, as written to ADC10SA
+ */
+unsigned short _sim_addr(void * p);
+
+/**
+ * Bit names
+ */
+#define BIT0        0x0001
+#define BIT1        0x0002
+#define BIT2        0x0004
+#define BIT3        0x0008
+#define BIT4        0x0010
+#define BIT5        0x0020
+#define BIT6        0x0040
+#define BIT7        0x0080
+#define BIT8        0x0100
+#define BIT9        0x0200
+#define BITA        0x0400
+#define BITB        0x0800
+#define BITC        0x1000
+#define BITD        0x2000
+#define BITE        0x4000
+#define BITF        0x8000
+
+// Status register
+#define GIE         0x0008
+#define CPUOFF      0x0010
+#define OSCOFF      0x0020
+#define SCG0        0x0040
+#define SCG1        0x0080
+#define LPM0_bits   (CPUOFF)
+#define LPM1_bits   (SCG0 + CPUOFF)
+#define LPM2_bits   (SCG1 + CPUOFF)
+#define LPM3_bits   (SCG1 + SCG0 + CPUOFF)
+#define LPM4_bits   (SCG1 + SCG0 + OSCOFF + CPUOFF)
+
+// Watchdog
+#define WDTPW       0x5A00
+#define WDTHOLD     0x0080
+
+// Basic clock
+#define XT2OFF      0x80
+#define XTS         0x40
+#define DIVA_0      0x00
+#define DIVA_1      0x10
+#define DIVA_2      0x20
+#define DIVA_3      0x30
+#define SELM_0      0x00
+#define SELM_1      0x40
+#define SELM_2      0x80
+#define SELM_3      0xC0
+#define DIVM_0      0x00
+#define DIVM_1      0x10
+#define DIVM_2      0x20
+#define DIVM_3      0x30
+#define SELS        0x08
+#define DIVS_0      0x00
+#define DIVS_1      0x02
+#define DIVS_2      0x04
+#define DIVS_3      0x06
+#define LFXT1S_0    0x00
+#define LFXT1S_2    0x20
+#define XCAP_0      0x00
+#define XCAP_1      0x04
+#define XCAP_2      0x08
+#define XCAP_3      0x0C
+#define LFXT1OF     0x01
+#define OFIFG       0x02
+
+// Timer_A
+#define TASSEL_0    0x0000
+#define TASSEL_1    0x0100
+#define TASSEL_2    0x0200
+#define TASSEL_3    0x0300
+#define ID_0        0x0000
+#define ID_1        0x0040
+#define ID_2        0x0080
+#define ID_3        0x00C0
+#define MC_0        0x0000
+#define MC_1        0x0010
+#define MC_2        0x0020
+#define MC_3        0x0030
+#define TACLR       0x0004
+#define TAIE        0x0002
+#define TAIFG       0x0001
+#define CM_0        0x0000
+#define CM_1        0x4000
+#define CM_2        0x8000
+#define CM_3        0xC000
+#define CCIS_0      0x0000
+#define CCIS_1      0x1000
+#define CCIS_2      0x2000
+#define CCIS_3      0x3000
+#define SCS         0x0800
+#define SCCI        0x0400
+#define CAP         0x0100
+#define OUTMOD0     0x0020
+#define OUTMOD1     0x0040
+#define OUTMOD2     0x0080
+#define OUTMOD_0    0x0000
+#define OUTMOD_1    0x0020
+#define OUTMOD_2    0x0040
+#define OUTMOD_3    0x0060
+#define OUTMOD_4    0x0080
+#define OUTMOD_5    0x00A0
+#define OUTMOD_6    0x00C0
+#define OUTMOD_7    0x00E0
+#define CCIE        0x0010
+#define CCI         0x0008
+#define OUT         0x0004
+#define COV         0x0002
+#define CCIFG       0x0001
+
+// USI
+#define USIPE7      0x80
+#define USIPE6      0x40
+#define USIPE5      0x20
+#define USILSB      0x10
+#define USIMST      0x08
+#define USIGE       0x04
+#define USIOE       0x02
+#define USISWRST    0x01
+#define USICKPH     0x80
+#define USII2C      0x40
+#define USISTTIE    0x20
+#define USIIE       0x10
+#define USIAL       0x08
+#define USISTP      0x04
+#define USISTTIFG   0x02
+#define USIIFG      0x01
+#define USICKPL     0x02
+#define USISWCLK    0x01
+#define USISCLREL   0x80
+#define USI16B      0x40
+#define USIIFGCC    0x20
+
+// ADC10
+#define SREF_0      0x0000
+#define SREF_1      0x2000
+#define ADC10SHT_0  0x0000
+#define ADC10SHT_1  0x0800
+#define ADC10SHT_2  0x1000
+#define ADC10SHT_3  0x1800
+#define ADC10SR     0x0400
+#define REFOUT      0x0200
+#define REFBURST    0x0100
+#define MSC         0x0080
+#define REF2_5V     0x0040
+#define REFON       0x0020
+#define ADC10ON     0x0010
+#define ADC10IE     0x0008
+#define ADC10IFG    0x0004
+#define ENC         0x0002
+#define ADC10SC     0x0001
+#define INCH_10     0xA000
+#define SHS_0       0x0000
+#define ADC10DF     0x0200
+#define ADC10DIV_0  0x0000
+#define ADC10DIV_3  0x0060
+#define ADC10DIV_7  0x00E0
+#define ADC10SSEL_0 0x0000
+#define ADC10SSEL_1 0x0008
+#define CONSEQ_0    0x0000
+#define CONSEQ_1    0x0002
+#define CONSEQ_2    0x0004
+#define CONSEQ_3    0x0006
+#define ADC10BUSY   0x0001
+#define ADC10TB     0x08
+#define ADC10CT     0x04
+#define ADC10B1     0x02
+#define ADC10FETCH  0x01
+
+// Flash
+#define FWKEY       0xA500
+#define FRKEY       0x9600
+#define BLKWRT      0x0080
+#define WRT         0x0040
+#define MERAS       0x0004
+#define ERASE       0x0002
+#define FSSEL_0     0x0000
+#define FSSEL_1     0x0040
+#define FSSEL_2     0x0080
+#define FN0         0x0001
+#define FN1         0x0002
+#define FN2         0x0004
+#define FN3         0x0008
+#define FN4         0x0010
+#define FN5         0x0020
+#define LOCKA       0x0040
+#define LOCK        0x0010
+#define WAIT        0x0008
+#define BUSY        0x0001
+
+/**
+ * Interrupt vectors are only names on host
+ * #pragma vector is ignored by the host compiler
+ */
+#define __interrupt
+#define USI_VECTOR          4
+#define ADC10_VECTOR        5
+#define TIMER0_A1_VECTOR    8
+#define TIMER0_A0_VECTOR    9
+
+/**
+ * Intrinsics
+ */
+void _sim_enable_interrupt();
+void _sim_disable_interrupt();
+void _sim_bis_SR_register(unsigned int bits);
+void _sim_bic_SR_register(unsigned int bits);
+void _sim_bic_SR_register_on_exit(unsigned int bits);
+unsigned int _sim_get_SR_register();
+void _sim_delay_cycles(unsigned long cycles);
+void _sim_loop_poll();
+
+#define __enable_interrupt()            _sim_enable_interrupt()
+#define __disable_interrupt()           _sim_disable_interrupt()
+#define __bis_SR_register(x)            _sim_bis_SR_register(x)
+#define __bic_SR_register(x)            _sim_bic_SR_register(x)
+#define __bic_SR_register_on_exit(x)    _sim_bic_SR_register_on_exit(x)
+#define __get_SR_register()             _sim_get_SR_register()
+#define __delay_cycles(x)               _sim_delay_cycles(x)
+#define __no_operation()                _sim_delay_cycles(1)
+#define __even_in_range(x, y)           (x)
+
+#endif /* MSP430_HOST_H_ */
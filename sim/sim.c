@@ -0,0 +1,959 @@
+/*
+ * Host simulator for the RTC firmware
+ *
+ * HouYu Li <karajan_ii@hotmail.com>
+ *
+ * No license applied. Use as you wish.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <ucontext.h>
+
+#include "msp430_host.h"
+#include "sim.h"
+
+/**
+ * Firmware entry and interrupt service routines
+ * Weak so that optional ISRs may be compiled out of the firmware
+ */
+void _firmware_main(void);
+void Timer_A0(void) __attribute__((weak));
+void Timer_A1(void) __attribute__((weak));
+void ADC10_ISR(void) __attribute__((weak));
+void USI_INT(void) __attribute__((weak));
+
+/**
+ * Register storage
+ */
+#define _SIM_DEFINE8(name)      volatile unsigned char _sim_##name;
+#define _SIM_DEFINE16(name)     volatile unsigned short _sim_##name;
+_SIM_REGS8(_SIM_DEFINE8)
+_SIM_REGS16(_SIM_DEFINE16)
+
+/**
+ * Shadows of the registers whose writes the peripherals react to
+ */
+static unsigned char _sh_USICNT, _sh_P1OUT, _sh_P2OUT, _sh_BCSCTL1, _sh_DCOCTL;
+static unsigned short _sh_ADC10CTL0;
+static unsigned short _taiv_value;
+
+/**
+ * CPU state
+ */
+static unsigned int _sr = 0;                // Status register
+static unsigned int _isr_sr = 0;            // Status register saved on interrupt entry
+static int _in_isr = 0;
+static unsigned long _mclk_hz = 1100000;    // DCO default after reset
+static double _t = 0;                       // Simulated time in seconds
+static unsigned long long _aclk_ticks = 0;  // ACLK ticks elapsed
+static double _aclk_hz = 32768.0;           // Crystal frequency, see _sim_update_aclk()
+static double _aclk_base_t = 0;             // Time of ACLK tick _aclk_base_n
+static unsigned long long _aclk_base_n = 0; // Tick the frequency last changed at
+static unsigned long long _accesses = 0;    // Register accesses so far
+static double _last_poll = 0;
+
+/**
+ * Board
+ */
+static unsigned long _strap_mhz = 1;
+static unsigned char _addr_low = 0;
+static double _temp_c = 25.0;
+static double _xtal_ppm = 0;                // Crystal error at the turnover temperature
+
+/**
+ * Timer_A output units and UART decoding on TA0.1
+ */
+static unsigned char _ta_out[3] = { 0, 0, 0 };
+static int _uart_bit = -1;                  // -1: idle, 0~7: data bits, 8: stop bit
+static unsigned char _uart_shift;
+static char _uart_buf[4096];
+static unsigned int _uart_len = 0;
+
+/**
+ * ADC10
+ * The converter has a gain error of +1% and an offset of +3 LSB, plus
+ * up to 0.7 LSB of noise. The TLV words below are what the factory
+ * calibration would have stored for it.
+ */
+static int _adc_busy = 0;
+static double _adc_done_t = 0;
+static unsigned int _adc_noise = 1;
+static unsigned short * _adc_dtc_ptr = 0;   // DTC destination
+static unsigned int _adc_dtc_left = 0;      // Words the DTC has still to transfer
+static int _adc_seq = 0;                    // Conversion is part of a sequence
+
+unsigned char _sim_TLV_ADC10_1_TAG = TAG_ADC10_1;
+const unsigned short _sim_TLV_ADC10[8] = {
+    32444,      // CAL_ADC_GAIN_FACTOR, 1 / 1.01
+    0xFFFD,     // CAL_ADC_OFFSET, -3
+    0x8000,     // CAL_ADC_15VREF_FACTOR
+    756,        // CAL_ADC_15T30
+    890,        // CAL_ADC_15T85
+    0x8000,     // CAL_ADC_25VREF_FACTOR
+    455,        // CAL_ADC_25T30
+    535,        // CAL_ADC_25T85
+};
+
+/**
+ * Information flash, what the firmware sees and what is programmed
+ */
+unsigned char _sim_info[192];
+static unsigned char _sh_info[192];
+static unsigned long _flash_erases = 0;
+static unsigned long _flash_bytes = 0;
+static int _info_loaded = 0;
+
+/**
+ * RAM objects handed out as bus addresses
+ */
+#define _SIM_ADDR_COUNT 8
+static void * _addr_map[_SIM_ADDR_COUNT];
+
+/**
+ * I2C master on the USI
+ */
+#define _M_IDLE         0
+#define _M_ADDR         1
+#define _M_ADDR_ACK     2
+#define _M_WDATA        3
+#define _M_WACK         4
+#define _M_RDATA        5
+#define _M_RACK         6
+#define _M_STOP         7
+
+static unsigned long _i2c_hz = 100000;
+static int _m_state = _M_IDLE;
+static unsigned char _m_addr;
+static const unsigned char * _m_wbuf;
+static unsigned char * _m_rbuf;
+static unsigned int _m_wlen, _m_rlen, _m_wpos, _m_rpos;
+static int _m_stop_on_release = 0;
+static int _usi_shifting = 0;
+static unsigned int _usi_bits;
+static double _usi_done_t = 0;
+static double _usi_hold_t = 0;              // Time SCL started to be held low
+static double _m_start_t = 0;
+static sim_i2c_result_t _m_result;
+
+/**
+ * Run control
+ */
+static ucontext_t _ctx_bench, _ctx_fw;
+static char _fw_stack[256 * 1024];
+static double _run_until = 0;
+static int _yield = 0;
+
+static sim_stats_t _stats;
+
+static void _sim_cpu(unsigned long cycles);
+static void _sim_sync();
+static void _sim_dispatch();
+
+/***********************************************
+ * Run control
+ ***********************************************/
+static void _sim_check_yield() {
+    if (_t >= _run_until || _yield) {
+        _yield = 0;
+        swapcontext(&_ctx_fw, &_ctx_bench);
+    }
+}
+
+static void _fw_entry() {
+    _firmware_main();
+    printf("sim: firmware main() returned\n");
+    for (;;)
+        swapcontext(&_ctx_fw, &_ctx_bench);
+}
+
+void sim_set_mclk_strap(unsigned long mhz) {
+    _strap_mhz = mhz;
+}
+
+void sim_set_addr_strap(unsigned char low) {
+    _addr_low = low;
+}
+
+/**
+ * Time of an ACLK tick
+ */
+static double _sim_aclk_time(unsigned long long n) {
+    return _aclk_base_t + (double)(n - _aclk_base_n) / _aclk_hz;
+}
+
+/**
+ * Tuning fork crystal, -0.034ppm per Celsius squared around 25C
+ * Ticks already counted keep their times.
+ */
+static void _sim_update_aclk() {
+    double dt = _temp_c - 25.0;
+    _aclk_base_t = _sim_aclk_time(_aclk_ticks);
+    _aclk_base_n = _aclk_ticks;
+    _aclk_hz = 32768.0 * (1.0 + (_xtal_ppm - 0.034 * dt * dt) * 1e-6);
+}
+
+void sim_set_temperature(double celsius) {
+    _temp_c = celsius;
+    _sim_update_aclk();
+}
+
+void sim_set_crystal_ppm(double ppm) {
+    _xtal_ppm = ppm;
+    _sim_update_aclk();
+}
+
+void sim_set_i2c_rate(unsigned long hz) {
+    _i2c_hz = hz;
+}
+
+void sim_boot() {
+    _sim_P1IN = 0xFF;
+    if (_addr_low)
+        _sim_P1IN &= ~BIT3;
+    _sim_P2IN = 0xFF;
+    if (_strap_mhz == 8)
+        _sim_P2IN &= ~BIT3;
+    if (_strap_mhz == 12)
+        _sim_P2IN &= ~BIT4;
+    if (_strap_mhz == 16)
+        _sim_P2IN &= ~BIT5;
+    _sim_USICTL0 = USISWRST;
+    _sim_USICTL1 = USIIFG;
+    _sim_FCTL3 = FWKEY + LOCK;
+    if (!_info_loaded) {                // Blank part
+        memset(_sim_info, 0xFF, sizeof(_sim_info));
+        memset(_sh_info, 0xFF, sizeof(_sh_info));
+    }
+
+    _sh_BCSCTL1 = _sim_BCSCTL1;
+    _sh_DCOCTL = _sim_DCOCTL;
+    memset(&_stats, 0, sizeof(_stats));
+    sim_stats_reset();
+
+    getcontext(&_ctx_fw);
+    _ctx_fw.uc_stack.ss_sp = _fw_stack;
+    _ctx_fw.uc_stack.ss_size = sizeof(_fw_stack);
+    _ctx_fw.uc_link = 0;
+    makecontext(&_ctx_fw, _fw_entry, 0);
+}
+
+void sim_run(double seconds) {
+    _run_until = _t + seconds;
+    swapcontext(&_ctx_bench, &_ctx_fw);
+}
+
+double sim_time() {
+    return _t;
+}
+
+unsigned long sim_mclk_hz() {
+    return _mclk_hz;
+}
+
+unsigned long sim_p1_0_hz() {
+    if ((_sim_P1SEL & _sim_P1DIR & BIT0) && !(_sim_P1SEL2 & BIT0))
+        return (unsigned long)(_aclk_hz + 0.5);
+    return 0;
+}
+
+/**
+ * Drive a P1 input, P1.2 feeds the TA0.1 capture input CCI1A
+ */
+void sim_p1_input(unsigned char bit, int level) {
+    unsigned char old = _sim_P1IN;
+    unsigned short edge;
+
+    if (level)
+        _sim_P1IN |= bit;
+    else
+        _sim_P1IN &= ~bit;
+    if (!(bit & BIT2) || old == _sim_P1IN || !(_sim_P1SEL & BIT2) || (_sim_P1DIR & BIT2))
+        return;
+    edge = level ? CM_1 : CM_2;
+    if ((_sim_TACCTL1 & (CAP | CCIS_3)) != (CAP | CCIS_0) || !(_sim_TACCTL1 & edge))
+        return;
+    if (_sim_TACCTL1 & CCIFG)           // Last capture not taken yet
+        _sim_TACCTL1 |= COV;
+    _sim_TACCR1 = _sim_TAR;
+    _sim_TACCTL1 |= CCIFG;
+}
+
+/***********************************************
+ * Peripherals
+ ***********************************************/
+static void _sim_update_mclk() {
+    unsigned long old = _mclk_hz;
+    if (_sim_BCSCTL1 == CALBC1_1MHZ && _sim_DCOCTL == CALDCO_1MHZ)
+        _mclk_hz = 1000000;
+    else if (_sim_BCSCTL1 == CALBC1_8MHZ && _sim_DCOCTL == CALDCO_8MHZ)
+        _mclk_hz = 8000000;
+    else if (_sim_BCSCTL1 == CALBC1_12MHZ && _sim_DCOCTL == CALDCO_12MHZ)
+        _mclk_hz = 12000000;
+    else if (_sim_BCSCTL1 == CALBC1_16MHZ && _sim_DCOCTL == CALDCO_16MHZ)
+        _mclk_hz = 16000000;
+    if (_mclk_hz != old) {
+        _stats.mclk_changes++;
+        _stats.mclk_change_t = _t;
+    }
+}
+
+static void _sim_ta_output(int ccr) {
+    volatile unsigned short * cctl = ccr == 0 ? &_sim_TACCTL0 : (ccr == 1 ? &_sim_TACCTL1 : &_sim_TACCTL2);
+    switch (*cctl & OUTMOD_7) {
+    case OUTMOD_1:
+        _ta_out[ccr] = 1;
+        break;
+    case OUTMOD_4:
+        _ta_out[ccr] ^= 1;
+        break;
+    case OUTMOD_5:
+        _ta_out[ccr] = 0;
+        break;
+    }
+    if (ccr != 1 || !(_sim_P1SEL & BIT2))
+        return;
+    // Decode UART from the TA0.1 output sampled at every bit compare
+    if (_uart_bit < 0) {
+        if (!_ta_out[1])
+            _uart_bit = 0;
+    } else if (_uart_bit < 8) {
+        _uart_shift = (_uart_shift >> 1) | (_ta_out[1] ? 0x80 : 0);
+        _uart_bit++;
+    } else {
+        if (_ta_out[1] && _uart_len < sizeof(_uart_buf))
+            _uart_buf[_uart_len++] = _uart_shift;
+        _uart_bit = -1;
+    }
+}
+
+static void _sim_aclk_tick() {
+    unsigned int mc;
+    int ccr;
+    volatile unsigned short * cctl[3] = { &_sim_TACCTL0, &_sim_TACCTL1, &_sim_TACCTL2 };
+    volatile unsigned short * ccr_v[3] = { &_sim_TACCR0, &_sim_TACCR1, &_sim_TACCR2 };
+
+    _aclk_ticks++;
+    if ((_sim_TACTL & TASSEL_3) != TASSEL_1)
+        return;
+    mc = _sim_TACTL & MC_3;
+    if (mc == MC_0)
+        return;
+    if (mc == MC_1 && _sim_TAR == _sim_TACCR0) {
+        _sim_TAR = 0;
+        _sim_TACTL |= TAIFG;
+    } else {
+        _sim_TAR = (_sim_TAR + 1) & 0xFFFF;
+        if (!_sim_TAR)
+            _sim_TACTL |= TAIFG;
+    }
+    for (ccr = 0; ccr < 3; ccr++) {
+        if (*cctl[ccr] & CAP)
+            continue;
+        if (_sim_TAR == *ccr_v[ccr]) {
+            *cctl[ccr] |= CCIFG;
+            _sim_ta_output(ccr);
+        }
+    }
+}
+
+static void _sim_adc_start() {
+    _adc_busy = 1;
+    _adc_seq = (_sim_ADC10CTL1 & CONSEQ_3) != 0;
+    _adc_done_t = _t + 77.0 / 1250000.0;    // SHT_3 + 13 clocks at ADC10OSC / 4
+    _sim_ADC10CTL1 |= ADC10BUSY;
+}
+
+static void _sim_adc_done() {
+    double v = 0.986 + 0.00355 * _temp_c;   // Sensor voltage, datasheet typical
+    double code;
+    _adc_noise = _adc_noise * 1103515245 + 12345;
+    code = v / 1.5 * 1023.0 * 1.01 + 3.0 + ((double)((_adc_noise >> 16) & 0x7FFF) / 0x7FFF - 0.5) * 1.4;
+    _adc_busy = 0;
+    _sim_ADC10CTL1 &= ~ADC10BUSY;
+    if (_adc_seq && !(_sim_ADC10CTL1 & CONSEQ_3) && !(_sim_ADC10CTL0 & ENC))
+        return;                             // Sequence stopped immediately
+    _sim_ADC10MEM = code < 0 ? 0 : (code > 1023 ? 1023 : (unsigned int)(code + 0.5));
+    if (_adc_dtc_left) {                    // Block transfer, one flag at the end
+        *_adc_dtc_ptr++ = _sim_ADC10MEM;
+        if (!--_adc_dtc_left)
+            _sim_ADC10CTL0 |= ADC10IFG;
+    } else {
+        _sim_ADC10CTL0 |= ADC10IFG;
+    }
+    if ((_sim_ADC10CTL1 & CONSEQ_2) && (_sim_ADC10CTL0 & (ENC | MSC)) == (ENC | MSC))
+        _sim_adc_start();                   // Repeat single channel
+}
+
+/**
+ * Information flash written by the firmware
+ * Erase and programming hold the CPU for the typical flash times,
+ * tERASE 4819 and tWORD 30 timing generator clocks at ~333kHz.
+ */
+static void _sim_flash() {
+    unsigned int i, seg;
+    unsigned long bytes = 0;
+    double ftg = (double)_mclk_hz / ((_sim_FCTL2 & 0x3F) + 1);   // Flash timing generator, MCLK divided
+
+    if (ftg < 257000.0 || ftg > 476000.0)
+        printf("sim: flash timing generator at %.0f Hz, out of 257~476 kHz\n", ftg);
+
+    if ((_sim_FCTL3 & LOCK) || !(_sim_FCTL1 & (ERASE | WRT))) {
+        printf("sim: write to locked information flash\n");
+        memcpy(_sim_info, _sh_info, sizeof(_sim_info));
+        return;
+    }
+    if (_sim_FCTL1 & ERASE) {
+        for (i = 0; i < sizeof(_sim_info); i++)
+            if (_sim_info[i] != _sh_info[i])
+                break;
+        seg = i & ~63;
+        memset(_sim_info + seg, 0xFF, 64);
+        memset(_sh_info + seg, 0xFF, 64);
+        _flash_erases++;
+        _sim_cpu((unsigned long)(4819.0 / ftg * _mclk_hz));
+        return;
+    }
+    for (i = 0; i < sizeof(_sim_info); i++) {
+        if (_sim_info[i] != _sh_info[i]) {
+            _sim_info[i] &= _sh_info[i];        // Programming only clears bits
+            _sh_info[i] = _sim_info[i];
+            bytes++;
+        }
+    }
+    _flash_bytes += bytes;
+    _sim_cpu((unsigned long)(bytes * 30.0 / ftg * _mclk_hz));
+}
+
+void sim_info_save(unsigned char * info) {
+    memcpy(info, _sh_info, sizeof(_sh_info));
+}
+
+void sim_info_load(const unsigned char * info) {
+    memcpy(_sh_info, info, sizeof(_sh_info));
+    memcpy(_sim_info, info, sizeof(_sim_info));
+    _info_loaded = 1;
+}
+
+unsigned long sim_flash_erases() {
+    return _flash_erases;
+}
+
+unsigned long sim_flash_bytes() {
+    return _flash_bytes;
+}
+
+unsigned short _sim_addr(void * p) {
+    unsigned int i;
+    for (i = 0; i < _SIM_ADDR_COUNT && _addr_map[i] && _addr_map[i] != p; i++)
+        ;
+    if (i == _SIM_ADDR_COUNT) {
+        printf("sim: out of bus addresses\n");
+        return 0;
+    }
+    _addr_map[i] = p;
+    return 0x0200 + (i << 4);
+}
+
+static void _sim_i2c_finish() {
+    _m_state = _M_IDLE;
+    _m_result.duration = _t - _m_start_t;
+    _sim_USICTL1 |= USISTP;
+    _usi_shifting = 0;
+    _yield = 1;
+}
+
+static void _sim_i2c_restart(unsigned char rw) {
+    _m_state = _M_ADDR;
+    _m_addr = (_m_addr & 0xFE) | rw;
+    _sim_USICTL1 |= USISTTIFG;
+    _sim_USICTL1 &= ~USISTP;
+    _usi_hold_t = _t;
+}
+
+/**
+ * The USI finished shifting the requested number of bits
+ */
+static void _sim_usi_done() {
+    unsigned char sda_bits;
+    unsigned char slave_drives = _sim_USICTL0 & USIOE;
+    unsigned char slave_byte = _sim_USISRL;
+
+    _usi_shifting = 0;
+    _m_result.bits += _usi_bits;
+    switch (_m_state) {
+    case _M_ADDR:
+        sda_bits = _m_addr;
+        _m_state = _M_ADDR_ACK;
+        break;
+    case _M_WDATA:
+        sda_bits = _m_wbuf[_m_wpos];
+        _m_state = _M_WACK;
+        break;
+    case _M_ADDR_ACK:
+    case _M_WACK:
+        sda_bits = slave_byte;
+        if (!slave_drives || (slave_byte & 0x80)) {         // NACK
+            _m_result.acked = 0;
+            _m_stop_on_release = 1;
+            break;
+        }
+        if (_m_state == _M_WACK)
+            _m_wpos++;
+        if (_m_addr & 1)
+            _m_state = _M_RDATA;
+        else if (_m_wpos < _m_wlen)
+            _m_state = _M_WDATA;
+        else if (_m_rlen)
+            _m_stop_on_release = 2;                         // Repeated start follows on release
+        else
+            _m_stop_on_release = 1;
+        break;
+    case _M_RDATA:
+        sda_bits = slave_byte;
+        _m_rbuf[_m_rpos] = slave_byte;
+        _m_state = _M_RACK;
+        break;
+    case _M_RACK:
+        sda_bits = (_m_rpos + 1 == _m_rlen) ? 0xFF : 0x00;  // NACK the last byte
+        if (++_m_rpos == _m_rlen)
+            _m_stop_on_release = 1;
+        else
+            _m_state = _M_RDATA;
+        break;
+    default:
+        sda_bits = 0xFF;
+    }
+
+    if (slave_drives)
+        _sim_USISRL = slave_byte << _usi_bits;
+    else if (_usi_bits >= 8)
+        _sim_USISRL = sda_bits;
+    else
+        _sim_USISRL = (slave_byte << _usi_bits) | (sda_bits >> (8 - _usi_bits));
+    _sim_USICNT &= ~0x1F;
+    _sh_USICNT = _sim_USICNT;
+    _sim_USICTL1 |= USIIFG;
+    _usi_hold_t = _t;
+}
+
+/**
+ * The slave released SCL, the master may go on with STOP or repeated START
+ */
+static void _sim_usi_release() {
+    if (_m_state == _M_IDLE)
+        return;
+    _m_result.stretch += _t - _usi_hold_t;
+    if (_m_stop_on_release)
+        _usi_shifting = 0;
+    if (_m_stop_on_release == 1) {
+        _m_stop_on_release = 0;
+        _m_state = _M_STOP;
+        _usi_done_t = _t + 1.0 / _i2c_hz;
+    } else if (_m_stop_on_release == 2) {
+        _m_stop_on_release = 0;
+        _sim_i2c_restart(1);
+    }
+}
+
+/**
+ * React on register values written by the firmware
+ */
+static void _sim_sync() {
+    unsigned char bit;
+
+    if (_sim_USICNT != _sh_USICNT) {
+        if (_sim_USICNT & 0x1F)
+            _sim_USICTL1 &= ~USIIFG;        // Writing a bit count clears the flag
+        else
+            _usi_shifting = 0;
+        _sh_USICNT = _sim_USICNT;
+    }
+    // Bits shift once SCL is no longer held, a count left from the last
+    // transaction is picked up when the START flag is cleared
+    if (!_usi_shifting && (_sim_USICNT & 0x1F) && !_m_stop_on_release
+            && !(_sim_USICTL1 & (USIIFG | USISTTIFG))
+            && _m_state != _M_IDLE && _m_state != _M_STOP) {
+        _usi_bits = _sim_USICNT & 0x1F;
+        _usi_shifting = 1;
+        _usi_done_t = _t + (double)_usi_bits / _i2c_hz;
+        _sim_usi_release();
+    }
+    if (!_usi_shifting && _m_state != _M_IDLE && _m_stop_on_release
+            && !(_sim_USICTL1 & (USIIFG | USISTTIFG)))
+        _sim_usi_release();
+
+    if (memcmp(_sim_info, _sh_info, sizeof(_sim_info)))
+        _sim_flash();
+
+    if (_sim_ADC10CTL0 != _sh_ADC10CTL0) {
+        if ((_sim_ADC10CTL0 & (ENC | ADC10SC | ADC10ON)) == (ENC | ADC10SC | ADC10ON) && !_adc_busy) {
+            _adc_dtc_left = 0;
+            if (_sim_ADC10DTC1) {           // DTC armed, find the buffer behind ADC10SA
+                _adc_dtc_ptr = _addr_map[((_sim_ADC10SA - 0x0200) >> 4) & (_SIM_ADDR_COUNT - 1)];
+                _adc_dtc_left = _adc_dtc_ptr ? _sim_ADC10DTC1 : 0;
+            }
+            _sim_adc_start();
+        }
+        _sim_ADC10CTL0 &= ~ADC10SC;
+        _sh_ADC10CTL0 = _sim_ADC10CTL0;
+    }
+
+    if (_sim_P1OUT != _sh_P1OUT || _sim_P2OUT != _sh_P2OUT) {
+        for (bit = 0; bit < 8; bit++) {
+            if ((_sim_P1OUT & ~_sh_P1OUT & _sim_P1DIR) & (1 << bit)) {
+                _stats.p1_rise[bit]++;
+                _stats.p1_rise_t[bit] = _t;
+            }
+            if ((_sim_P2OUT & ~_sh_P2OUT & _sim_P2DIR) & (1 << bit))
+                _stats.p2_rise[bit]++;
+        }
+        _sh_P1OUT = _sim_P1OUT;
+        _sh_P2OUT = _sim_P2OUT;
+    }
+
+    if (_sim_BCSCTL1 != _sh_BCSCTL1 || _sim_DCOCTL != _sh_DCOCTL) {
+        _sim_update_mclk();
+        _sh_BCSCTL1 = _sim_BCSCTL1;
+        _sh_DCOCTL = _sim_DCOCTL;
+    }
+}
+
+/**
+ * Let the peripherals run up to the current time
+ */
+static void _sim_events() {
+    for (;;) {
+        double next_aclk = _sim_aclk_time(_aclk_ticks + 1);
+        double next = next_aclk;
+        int which = 0;
+        if (_adc_busy && _adc_done_t < next) {
+            next = _adc_done_t;
+            which = 1;
+        }
+        if ((_usi_shifting || _m_state == _M_STOP) && _usi_done_t < next) {
+            next = _usi_done_t;
+            which = 2;
+        }
+        if (next > _t)
+            break;
+        if (which == 0)
+            _sim_aclk_tick();
+        else if (which == 1)
+            _sim_adc_done();
+        else if (_m_state == _M_STOP)
+            _sim_i2c_finish();
+        else
+            _sim_usi_done();
+    }
+}
+
+/**
+ * Time of the next peripheral event for low power mode fast forward
+ */
+static double _sim_next_event() {
+    double next = _sim_aclk_time(_aclk_ticks + 1);
+    if (_adc_busy && _adc_done_t < next)
+        next = _adc_done_t;
+    if ((_usi_shifting || _m_state == _M_STOP) && _usi_done_t < next)
+        next = _usi_done_t;
+    return next;
+}
+
+/***********************************************
+ * CPU
+ ***********************************************/
+static void _sim_cpu(unsigned long cycles) {
+    _stats.active_cycles += cycles;
+    _stats.active_time += (double)cycles / _mclk_hz;
+    _t += (double)cycles / _mclk_hz;
+    _sim_events();
+    _sim_dispatch();
+    if (!_in_isr)
+        _sim_check_yield();
+}
+
+static int _sim_pending() {
+    if ((_sim_TACCTL0 & (CCIE | CCIFG)) == (CCIE | CCIFG))
+        return _SIM_ISR_TIMER_A0;
+    if ((_sim_TACCTL1 & (CCIE | CCIFG)) == (CCIE | CCIFG)
+            || (_sim_TACCTL2 & (CCIE | CCIFG)) == (CCIE | CCIFG)
+            || (_sim_TACTL & (TAIE | TAIFG)) == (TAIE | TAIFG))
+        return _SIM_ISR_TIMER_A1;
+    if ((_sim_ADC10CTL0 & (ADC10IE | ADC10IFG)) == (ADC10IE | ADC10IFG))
+        return _SIM_ISR_ADC10;
+    if ((_sim_USICTL1 & (USIIE | USIIFG)) == (USIIE | USIIFG)
+            || (_sim_USICTL1 & (USISTTIE | USISTTIFG)) == (USISTTIE | USISTTIFG))
+        return _SIM_ISR_USI;
+    return -1;
+}
+
+static void _sim_dispatch() {
+    int vec;
+    void (*isr)(void);
+    unsigned long long c0, a0;
+    unsigned long cycles;
+
+    while (!_in_isr && (_sr & GIE) && (vec = _sim_pending()) >= 0) {
+        switch (vec) {
+        case _SIM_ISR_TIMER_A0:
+            _sim_TACCTL0 &= ~CCIFG;         // Single source vector, flag cleared on accept
+            isr = Timer_A0;
+            break;
+        case _SIM_ISR_TIMER_A1:
+            isr = Timer_A1;
+            break;
+        case _SIM_ISR_ADC10:
+            _sim_ADC10CTL0 &= ~ADC10IFG;    // Single source vector
+            _sh_ADC10CTL0 = _sim_ADC10CTL0;
+            isr = ADC10_ISR;
+            break;
+        default:
+            isr = USI_INT;
+        }
+        if (!isr) {
+            printf("sim: no handler for vector %d\n", vec);
+            _sr &= ~GIE;
+            return;
+        }
+        if (_sr & CPUOFF)
+            _stats.wakeups++;
+        _isr_sr = _sr;
+        _sr &= ~(GIE | LPM4_bits);
+        _in_isr = 1;
+        c0 = _stats.active_cycles;
+        a0 = _accesses;
+        _sim_cpu(_SIM_ISR_CYCLES);
+        isr();
+        _sim_sync();
+        cycles = (unsigned long)(_stats.active_cycles - c0);
+        _stats.isr[vec].calls++;
+        _stats.isr[vec].cycles += cycles;
+        _stats.isr[vec].accesses += _accesses - a0;
+        if (cycles > _stats.isr[vec].cycles_max)
+            _stats.isr[vec].cycles_max = cycles;
+        _in_isr = 0;
+        _sr = _isr_sr;
+    }
+}
+
+/**
+ * Sleep in a low power mode until an interrupt clears CPUOFF on exit
+ */
+static void _sim_sleep() {
+    int mode;
+    double next;
+
+    while (_sr & CPUOFF) {
+        if ((_sr & LPM4_bits) == LPM4_bits)
+            mode = 4;
+        else if ((_sr & LPM3_bits) == LPM3_bits)
+            mode = 3;
+        else if (_sr & SCG1)
+            mode = 2;
+        else if (_sr & SCG0)
+            mode = 1;
+        else
+            mode = 0;
+        next = _sim_next_event();
+        if (next > _run_until && _t < _run_until)
+            next = _run_until;
+        if (next > _t) {
+            _stats.sleep_time[mode] += next - _t;
+            _t = next;
+        }
+        _sim_events();
+        _sim_dispatch();
+        _sim_check_yield();
+    }
+}
+
+volatile unsigned char * _sim_r8(volatile unsigned char * reg) {
+    _accesses++;
+    _sim_sync();
+    _sim_cpu(_SIM_REG_CYCLES);
+    return reg;
+}
+
+volatile unsigned short * _sim_r16(volatile unsigned short * reg) {
+    _accesses++;
+    _sim_sync();
+    _sim_cpu(_SIM_REG_CYCLES);
+    return reg;
+}
+
+volatile unsigned short * _sim_taiv() {
+    _accesses++;
+    _sim_sync();
+    _sim_cpu(_SIM_REG_CYCLES);
+    // Highest pending Timer_A1 source, reading clears it
+    if ((_sim_TACCTL1 & (CCIE | CCIFG)) == (CCIE | CCIFG)) {
+        _sim_TACCTL1 &= ~CCIFG;
+        _taiv_value = 0x02;
+    } else if ((_sim_TACCTL2 & (CCIE | CCIFG)) == (CCIE | CCIFG)) {
+        _sim_TACCTL2 &= ~CCIFG;
+        _taiv_value = 0x04;
+    } else if ((_sim_TACTL & (TAIE | TAIFG)) == (TAIE | TAIFG)) {
+        _sim_TACTL &= ~TAIFG;
+        _taiv_value = 0x0A;
+    } else {
+        _taiv_value = 0;
+    }
+    return &_taiv_value;
+}
+
+void _sim_enable_interrupt() {
+    _sim_sync();
+    _sr |= GIE;
+    _sim_cpu(1);
+}
+
+void _sim_disable_interrupt() {
+    _sim_sync();
+    _sr &= ~GIE;
+    _sim_cpu(1);
+}
+
+void _sim_bis_SR_register(unsigned int bits) {
+    _sim_sync();
+    _sr |= bits;
+    _sim_cpu(1);
+    if (_sr & CPUOFF)
+        _sim_sleep();
+}
+
+void _sim_bic_SR_register(unsigned int bits) {
+    _sim_sync();
+    _sr &= ~bits;
+    _sim_cpu(1);
+}
+
+void _sim_bic_SR_register_on_exit(unsigned int bits) {
+    if (_in_isr)
+        _isr_sr &= ~bits;
+    _sim_cpu(2);
+}
+
+unsigned int _sim_get_SR_register() {
+    return _in_isr ? (_sr & ~GIE) : _sr;
+}
+
+/**
+ * Function call cost, hooked in by -finstrument-functions
+ * Interrupt entry is charged on dispatch already
+ */
+void __cyg_profile_func_enter(void * fn, void * site) {
+    (void)site;
+    if (fn == (void *)Timer_A0 || fn == (void *)Timer_A1 ||
+            fn == (void *)ADC10_ISR || fn == (void *)USI_INT ||
+            fn == (void *)_firmware_main)
+        return;
+    _sim_cpu(_SIM_CALL_CYCLES);
+}
+
+void __cyg_profile_func_exit(void * fn, void * site) {
+    (void)fn;
+    (void)site;
+}
+
+void _sim_delay_cycles(unsigned long cycles) {
+    _sim_sync();
+    _sim_cpu(cycles);
+}
+
+void _sim_loop_poll() {
+    double pass;
+    _sim_sync();
+    _sim_cpu(_SIM_LOOP_CYCLES);
+    pass = _t - _last_poll;
+    if (pass > _stats.loop_pass_max)
+        _stats.loop_pass_max = pass;
+    _stats.loop_passes++;
+    _last_poll = _t;
+}
+
+/***********************************************
+ * I2C master
+ ***********************************************/
+static sim_i2c_result_t _sim_i2c_xfer(unsigned char addr, const unsigned char * w, unsigned int wlen,
+        unsigned char * r, unsigned int rlen) {
+    double timeout = _t + 1.0;
+
+    memset(&_m_result, 0, sizeof(_m_result));
+    _m_result.acked = 1;
+    _m_wbuf = w;
+    _m_wlen = wlen;
+    _m_wpos = 0;
+    _m_rbuf = r;
+    _m_rlen = rlen;
+    _m_rpos = 0;
+    _m_stop_on_release = 0;
+    _m_start_t = _t;
+    _m_addr = addr << 1;
+    _sim_i2c_restart(wlen ? 0 : 1);
+    while (_m_state != _M_IDLE && _t < timeout)
+        sim_run(timeout - _t);
+    if (_m_state != _M_IDLE) {
+        printf("sim: I2C transaction timed out\n");
+        _m_state = _M_IDLE;
+        _m_result.acked = 0;
+    }
+    return _m_result;
+}
+
+sim_i2c_result_t sim_i2c_write(unsigned char addr, const unsigned char * data, unsigned int len) {
+    return _sim_i2c_xfer(addr, data, len, 0, 0);
+}
+
+sim_i2c_result_t sim_i2c_read(unsigned char addr, unsigned char reg, unsigned char * data, unsigned int len) {
+    return _sim_i2c_xfer(addr, &reg, 1, data, len);
+}
+
+unsigned int sim_uart_take(char * buf, unsigned int size) {
+    unsigned int n = _uart_len < size ? _uart_len : size;
+    memcpy(buf, _uart_buf, n);
+    memmove(_uart_buf, _uart_buf + n, _uart_len - n);
+    _uart_len -= n;
+    return n;
+}
+
+/***********************************************
+ * Statistics
+ ***********************************************/
+void sim_stats_reset() {
+    static const char * names[_SIM_ISR_COUNT] = { "Timer_A0", "Timer_A1", "ADC10_ISR", "USI_INT" };
+    int i;
+    memset(&_stats, 0, sizeof(_stats));
+    for (i = 0; i < _SIM_ISR_COUNT; i++)
+        _stats.isr[i].name = names[i];
+    _stats.time = _t;
+    _last_poll = _t;
+}
+
+const sim_stats_t * sim_stats() {
+    return &_stats;
+}
+
+void sim_report() {
+    int i;
+    double span = _t - _stats.time;
+
+    printf("   -- %.3f s simulated, MCLK %lu Hz, %lu DCO changes\n", span, _mclk_hz, _stats.mclk_changes);
+    printf("   %-10s %8s %8s %10s %10s %10s\n", "ISR", "calls", "per s", "avg cyc", "max cyc", "avg regs");
+    for (i = 0; i < _SIM_ISR_COUNT; i++) {
+        const sim_isr_stat_t * s = &_stats.isr[i];
+        if (!s->calls)
+            continue;
+        printf("   %-10s %8lu %8.1f %10.1f %10lu %10.1f\n", s->name, s->calls, s->calls / span,
+                (double)s->cycles / s->calls, s->cycles_max, (double)s->accesses / s->calls);
+    }
+    printf("   CPU active %.2f%% (%llu cycles), LPM0 %.2f%%, LPM3 %.2f%%, wakeups %lu (%.1f/s)\n",
+            100.0 * _stats.active_time / span, _stats.active_cycles,
+            100.0 * _stats.sleep_time[0] / span, 100.0 * _stats.sleep_time[3] / span,
+            _stats.wakeups, _stats.wakeups / span);
+    printf("   Timer_A0 wakeups %.1f/s, 1-Hz edges %lu, alarm pulses %lu, temperature pulses %lu\n",
+            _stats.isr[_SIM_ISR_TIMER_A0].calls / span, _stats.p1_rise[0], _stats.p1_rise[5], _stats.p1_rise[4]);
+    if (_stats.loop_passes)
+        printf("   Main loop %lu passes, longest pass %.3f ms\n",
+                _stats.loop_passes, _stats.loop_pass_max * 1000.0);
+}
@@ -0,0 +1,119 @@
+/*
+ * Host simulator for the RTC firmware
+ *
+ * HouYu Li <karajan_ii@hotmail.com>
+ *
+ * No license applied. Use as you wish.
+ *
+ * Emulates Timer_A, USI (I2C slave side with a scripted master),
+ * ADC10 temperature channel, the basic clock module and the GPIO ports,
+ * and runs the unmodified firmware against them on a virtual clock.
+ *
+ * Cost model
+ *      Each peripheral register access is charged _SIM_REG_CYCLES MCLK
+ *      cycles, interrupt entry and RETI are charged as on the CPU, and
+ *      each main loop pass is charged _SIM_LOOP_CYCLES. When built with
+ *      -finstrument-functions every firmware function call is charged
+ *      _SIM_CALL_CYCLES as well. This is an estimate to compare firmware
+ *      revisions, not a cycle exact model.
+ *
+ * Build on host (from the repository root)
+ *      gcc -O2 -D_HAL_HOST -I. -finstrument-functions \
+ *          -finstrument-functions-exclude-file-list=sim/ -o rtc_sim \
+ *          main.c USI_I2C_slave.c TA_scheduler.c info_flash.c \
+ *          sim/sim.c sim/bench.c
+ */
+
+#ifndef SIM_H_
+#define SIM_H_
+
+#define _SIM_REG_CYCLES     4       // MCLK cycles per register access
+#define _SIM_ISR_CYCLES     11      // Interrupt entry (6) + RETI (5)
+#define _SIM_LOOP_CYCLES    10      // One main loop pass without work
+#define _SIM_CALL_CYCLES    8       // CALL (5) + RET (3)
+
+#define _SIM_ISR_TIMER_A0   0
+#define _SIM_ISR_TIMER_A1   1
+#define _SIM_ISR_ADC10      2
+#define _SIM_ISR_USI        3
+#define _SIM_ISR_COUNT      4
+
+typedef struct {
+    const char * name;
+    unsigned long calls;
+    unsigned long long cycles;
+    unsigned long cycles_max;
+    unsigned long long accesses;
+} sim_isr_stat_t;
+
+typedef struct {
+    double time;                        // Simulated seconds
+    unsigned long long active_cycles;   // MCLK cycles with CPU on
+    double active_time;                 // Seconds with CPU on
+    double sleep_time[5];               // Seconds spent in LPM0~LPM4
+    unsigned long wakeups;              // Number of exits from a low power mode
+    unsigned long loop_passes;          // Main loop passes
+    double loop_pass_max;               // Longest main loop pass in seconds
+    unsigned long p1_rise[8];           // Rising edges seen on P1 outputs
+    double p1_rise_t[8];                // Time of the last rising edge on P1 outputs
+    unsigned long p2_rise[8];           // Rising edges seen on P2 outputs
+    unsigned long mclk_changes;         // DCO frequency changes
+    double mclk_change_t;               // Time of the last DCO frequency change
+    sim_isr_stat_t isr[_SIM_ISR_COUNT];
+} sim_stats_t;
+
+typedef struct {
+    int acked;                          // 1: whole transaction was ACKed
+    double duration;                    // START to STOP in seconds
+    unsigned int bits;                  // SCL clocks on the bus
+    double stretch;                     // Time SCL was held low by the slave
+} sim_i2c_result_t;
+
+/**
+ * Board and environment setup, call before sim_boot()
+ */
+void sim_set_mclk_strap(unsigned long mhz);     // 1, 8, 12 or 16
+void sim_set_addr_strap(unsigned char low);     // P1.3 pulled low
+void sim_set_temperature(double celsius);
+void sim_set_crystal_ppm(double ppm);           // Crystal error at 25C, positive runs fast
+                                                // -0.034ppm/C^2 away from 25C on top
+void sim_set_i2c_rate(unsigned long hz);
+
+/**
+ * Information flash segments D, C and B, 192 bytes
+ * Load before sim_boot() to start with what an earlier run saved
+ */
+void sim_info_save(unsigned char * info);
+void sim_info_load(const unsigned char * info);
+unsigned long sim_flash_erases();
+unsigned long sim_flash_bytes();
+
+/**
+ * Start the firmware and run it for some simulated time
+ */
+void sim_boot();
+void sim_run(double seconds);
+double sim_time();
+unsigned long sim_mclk_hz();
+void sim_p1_input(unsigned char bit, int level);    // P1.2 edges are captured on TA0.1
+unsigned long sim_p1_0_hz();                        // ACLK frequency while routed to P1.0, else 0
+
+/**
+ * I2C master, runs the simulation until the transaction ends
+ */
+sim_i2c_result_t sim_i2c_write(unsigned char addr, const unsigned char * data, unsigned int len);
+sim_i2c_result_t sim_i2c_read(unsigned char addr, unsigned char reg, unsigned char * data, unsigned int len);
+
+/**
+ * UART bytes decoded from the TA0.1 output
+ */
+unsigned int sim_uart_take(char * buf, unsigned int size);
+
+/**
+ * Statistics
+ */
+void sim_stats_reset();
+const sim_stats_t * sim_stats();
+void sim_report();
+
+#endif /* SIM_H_ */